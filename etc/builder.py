@@ -27,7 +27,18 @@ class LinkamT96(Device):
             ip_port=None,
             log_path="/dev/null",
             tensile=False,
-            lic_path="/dls_sw/prod/R3.14.12.7/support/linkam3Lsk/1-0/Linkam.lsk"
+            lic_path="/dls_sw/prod/R3.14.12.7/support/linkam3Lsk/1-0/Linkam.lsk",
+            poll_period=100,
+            data_rate=0,
+            replay_file="",
+            replay_speed=1.0,
+            emulated_stage="",
+            emulated_lnp=False,
+            emulated_rh=False,
+            usb_serial="",
+            baud_rate=115200,
+            msg_timeout=0,
+            port_timeout=0
         ):
         # Call super class
         self.__super.__init__()
@@ -62,6 +73,17 @@ class LinkamT96(Device):
         self.ip_address = ip_address
         self.ip_port = ip_port
         self.tensile = tensile
+        self.poll_period = poll_period
+        self.data_rate = data_rate
+        self.replay_file = replay_file
+        self.replay_speed = replay_speed
+        self.emulated_stage = emulated_stage
+        self.emulated_lnp = emulated_lnp
+        self.emulated_rh = emulated_rh
+        self.usb_serial = usb_serial
+        self.baud_rate = baud_rate
+        self.msg_timeout = msg_timeout
+        self.port_timeout = port_timeout
 
         # If we are instantiating a virtual port, then include the dbd support
         # for invoking system commands so we can use socat
@@ -88,6 +110,17 @@ class LinkamT96(Device):
         log_path=Simple("Log file path for the Linkam SDK", str),
         lic_path=Simple("License path for Linkam SDK", str),
         tensile=Simple("Tensile stage present?", bool),
+        poll_period=Simple("Readback acquisition period (ms)", int),
+        data_rate=Simple("SDK data request rate (ms, 5-1000), 0 for the SDK default", int),
+        replay_file=Simple("Recorded run to replay instead of connecting to a controller", str),
+        replay_speed=Simple("Replay speed factor, 1 for the original timing", float),
+        emulated_stage=Simple("Stage type for the SDK to emulate (e.g. standard, tensile), empty for a real controller", str),
+        emulated_lnp=Simple("Emulated stage has an LNP", bool),
+        emulated_rh=Simple("Emulated stage has humidity control", bool),
+        usb_serial=Simple("Serial number of the USB controller to use when serial_port is empty, needed if there is more than one", str),
+        baud_rate=Simple("Serial port baud rate", int),
+        msg_timeout=Simple("Time to wait for a complete reply to a message (ms), 0 for the SDK default", int),
+        port_timeout=Simple("Time to wait for data at the serial port (ms), 0 for the SDK default", int),
     )
 
     def Initialise(self):
@@ -116,10 +149,22 @@ class LinkamT96(Device):
             print('epicsThreadSleep 5')
         print('# Linkam 3.0 connect')
         print(
-            'linkamConnect "{P}_AP", "{serial_port}", "{log_path}", "{lic_path}"'.format(
+            'linkamConnect "{P}_AP", "{serial_port}", "{log_path}", "{lic_path}", {poll_period}, {data_rate}, "{replay_file}", {replay_speed}, '
+            '"{emulated_stage}", {emulated_lnp:d}, {emulated_rh:d}, "{usb_serial}", {baud_rate}, {msg_timeout}, {port_timeout}'.format(
                 P=self.P,
                 serial_port=self.serial_port,
                 log_path=self.log_path,
-                lic_path=self.lic_path
+                lic_path=self.lic_path,
+                poll_period=self.poll_period,
+                data_rate=self.data_rate,
+                replay_file=self.replay_file,
+                replay_speed=self.replay_speed,
+                emulated_stage=self.emulated_stage,
+                emulated_lnp=self.emulated_lnp,
+                emulated_rh=self.emulated_rh,
+                usb_serial=self.usb_serial,
+                baud_rate=self.baud_rate,
+                msg_timeout=self.msg_timeout,
+                port_timeout=self.port_timeout
             )
         )
@@ -0,0 +1,251 @@
+//
+// Throughput benchmark for the Linkam port driver. Connects a driver to the SDK stand-in,
+// then drives it the way an IOC would: N clients read the readbacks at a scan rate through
+// asynFloat64SyncIO, the way periodically scanned records do, while another client writes
+// the setpoint. Reports sustained reads/s, write-to-hardware latency and CPU time per
+// update, so runs before and after a driver change can be compared.
+//
+#include <epicsEvent.h>
+#include <epicsExit.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <iocsh.h>
+#include <asynDriver.h>
+#include <asynFloat64.h>
+#include <asynFloat64SyncIO.h>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+#include "linkamT96.h"
+
+void linkamRegistrar(void);
+void linkamSimRegistrar(void);
+
+#define BENCH_PORT "BENCH"
+// Timeout of each client request (s)
+#define BENCH_TIMEOUT 5.0
+
+static const char *heaterParams[] = { P_TempString, P_RampRateString, P_SetpointString, P_PowerString, P_LNPSpeedString };
+static const char *tensileParams[] = { P_TstMotorPosString, P_ForceString, P_StrainString, P_StressString };
+
+static volatile bool running = true;
+
+struct BenchClient
+{
+	double period;
+	std::vector<asynUser *> users;
+	unsigned long reads;
+	unsigned long failures;
+	epicsEventId done;
+};
+
+struct BenchWriter
+{
+	double period;
+	asynUser *user;
+	std::vector<double> latencies; // s
+	unsigned long failures;
+	epicsEventId done;
+};
+
+static void clientTask(void *pvt)
+{
+	BenchClient *client = (BenchClient *)pvt;
+	epicsTimeStamp next, now;
+	double value, delay;
+	size_t i;
+
+	epicsTimeGetCurrent(&next);
+	while (running) {
+		for (i = 0; i < client->users.size(); i++) {
+			if (pasynFloat64SyncIO->read(client->users[i], &value, BENCH_TIMEOUT) == asynSuccess)
+				client->reads++;
+			else
+				client->failures++;
+		}
+		// Keep to the scan rate, the way the scan threads do, rather than drifting by the read time
+		epicsTimeAddSeconds(&next, client->period);
+		epicsTimeGetCurrent(&now);
+		delay = epicsTimeDiffInSeconds(&next, &now);
+		if (delay > 0)
+			epicsThreadSleep(delay);
+		else
+			next = now;
+	}
+	epicsEventSignal(client->done);
+}
+
+//
+// \brief     Write the setpoint back and forth. The write completes once the driver has handed
+//            it to the SDK, so its round trip is the write-to-hardware latency.
+//
+static void writerTask(void *pvt)
+{
+	BenchWriter *writer = (BenchWriter *)pvt;
+	epicsTimeStamp start, end;
+	double setpoint = 30.0;
+
+	while (running) {
+		setpoint = setpoint == 30.0 ? 31.0 : 30.0;
+		epicsTimeGetCurrent(&start);
+		if (pasynFloat64SyncIO->write(writer->user, setpoint, BENCH_TIMEOUT) == asynSuccess) {
+			epicsTimeGetCurrent(&end);
+			writer->latencies.push_back(epicsTimeDiffInSeconds(&end, &start));
+		} else {
+			writer->failures++;
+		}
+		epicsThreadSleep(writer->period);
+	}
+	epicsEventSignal(writer->done);
+}
+
+// Counts the values the driver publishes
+static void updateCallback(void *userPvt, asynUser *pasynUser, epicsFloat64 data)
+{
+	(void)pasynUser;
+	(void)data;
+	__sync_fetch_and_add((unsigned long *)userPvt, 1);
+}
+
+static double cpuSeconds(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+	if (sorted.empty())
+		return 0.0;
+	return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-c clients] [-r scanHz] [-w writeHz] [-t seconds] [-p pollPeriodMs]\n"
+	       "          [-d dataRateMs] [-s emulatedStage] [-l latencyMs] [-j jitterMs]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	int clients = 10, pollPeriodMs = 100, dataRateMs = 100, opt;
+	double scanRate = 10.0, writeRate = 1.0, duration = 10.0, latency = 0.0, jitter = 0.0;
+	const char *stage = "standard";
+	std::vector<const char *> params(heaterParams, heaterParams + sizeof(heaterParams) / sizeof(heaterParams[0]));
+	std::vector<BenchClient> benchClients;
+	std::vector<asynUser *> monitors;
+	BenchWriter writer;
+	unsigned long updates = 0, reads = 0, failures = 0;
+	epicsTimeStamp start, end;
+	double cpuStart, cpu, elapsed;
+	char command[256];
+	asynUser *pasynUser;
+	asynInterface *pasynInterface;
+	void *registrarPvt;
+	size_t i, j;
+
+	while ((opt = getopt(argc, argv, "c:r:w:t:p:d:s:l:j:h")) != -1) {
+		switch (opt) {
+		case 'c': clients = atoi(optarg); break;
+		case 'r': scanRate = atof(optarg); break;
+		case 'w': writeRate = atof(optarg); break;
+		case 't': duration = atof(optarg); break;
+		case 'p': pollPeriodMs = atoi(optarg); break;
+		case 'd': dataRateMs = atoi(optarg); break;
+		case 's': stage = optarg; break;
+		case 'l': latency = atof(optarg); break;
+		case 'j': jitter = atof(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if (clients < 0 || scanRate <= 0 || writeRate <= 0 || duration <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	linkamRegistrar();
+	linkamSimRegistrar();
+	snprintf(command, sizeof(command), "linkamSimFault all %g %g 0", latency, jitter);
+	iocshCmd(command);
+	snprintf(command, sizeof(command), "linkamConnect %s \"\" /dev/null \"\" %d %d \"\" 1 %s 1 0",
+	         BENCH_PORT, pollPeriodMs, dataRateMs, stage);
+	iocshCmd(command);
+	if (strstr(stage, "tensile"))
+		params.insert(params.end(), tensileParams, tensileParams + sizeof(tensileParams) / sizeof(tensileParams[0]));
+
+	for (i = 0; i < params.size(); i++) {
+		if (pasynFloat64SyncIO->connect(BENCH_PORT, 0, &pasynUser, params[i]) != asynSuccess) {
+			printf("linkamBench: cannot connect to %s %s\n", BENCH_PORT, params[i]);
+			return 1;
+		}
+		pasynInterface = pasynManager->findInterface(pasynUser, asynFloat64Type, 1);
+		((asynFloat64 *)pasynInterface->pinterface)->registerInterruptUser(pasynInterface->drvPvt, pasynUser,
+		                                                                   updateCallback, &updates, &registrarPvt);
+		monitors.push_back(pasynUser);
+	}
+
+	benchClients.resize(clients);
+	for (i = 0; i < benchClients.size(); i++) {
+		benchClients[i].period = 1.0 / scanRate;
+		benchClients[i].reads = 0;
+		benchClients[i].failures = 0;
+		benchClients[i].done = epicsEventMustCreate(epicsEventEmpty);
+		for (j = 0; j < params.size(); j++) {
+			pasynFloat64SyncIO->connect(BENCH_PORT, 0, &pasynUser, params[j]);
+			benchClients[i].users.push_back(pasynUser);
+		}
+	}
+	writer.period = 1.0 / writeRate;
+	writer.failures = 0;
+	writer.done = epicsEventMustCreate(epicsEventEmpty);
+	pasynFloat64SyncIO->connect(BENCH_PORT, 0, &writer.user, P_SetpointSetString);
+
+	// Let the driver finish its first full poll before measuring
+	epicsThreadSleep(1.0);
+	printf("linkamBench: %d clients reading %d values at %g Hz, writing at %g Hz for %g s\n",
+	       clients, (int)params.size(), scanRate, writeRate, duration);
+
+	updates = 0;
+	epicsTimeGetCurrent(&start);
+	cpuStart = cpuSeconds();
+	for (i = 0; i < benchClients.size(); i++)
+		epicsThreadCreate("linkamBenchClient", epicsThreadPriorityMedium,
+		                  epicsThreadGetStackSize(epicsThreadStackMedium), clientTask, &benchClients[i]);
+	epicsThreadCreate("linkamBenchWriter", epicsThreadPriorityMedium,
+	                  epicsThreadGetStackSize(epicsThreadStackMedium), writerTask, &writer);
+
+	epicsThreadSleep(duration);
+	running = false;
+	for (i = 0; i < benchClients.size(); i++)
+		epicsEventWait(benchClients[i].done);
+	epicsEventWait(writer.done);
+	epicsTimeGetCurrent(&end);
+	cpu = cpuSeconds() - cpuStart;
+	elapsed = epicsTimeDiffInSeconds(&end, &start);
+
+	for (i = 0; i < benchClients.size(); i++) {
+		reads += benchClients[i].reads;
+		failures += benchClients[i].failures;
+	}
+	std::sort(writer.latencies.begin(), writer.latencies.end());
+
+	printf("reads          %10.1f /s (%lu in %.2f s, %lu failed)\n", reads / elapsed, reads, elapsed, failures);
+	printf("updates        %10.1f /s (values published by the driver)\n", updates / elapsed);
+	printf("write latency  p50 %.3f ms  p99 %.3f ms  max %.3f ms (%lu writes, %lu failed)\n",
+	       percentile(writer.latencies, 0.50) * 1000, percentile(writer.latencies, 0.99) * 1000,
+	       writer.latencies.empty() ? 0.0 : writer.latencies.back() * 1000,
+	       (unsigned long)writer.latencies.size(), writer.failures);
+	printf("cpu            %10.1f %% (%.3f s)\n", cpu / elapsed * 100, cpu);
+	printf("cpu per read   %10.2f us\n", reads ? cpu / reads * 1e6 : 0.0);
+	printf("cpu per update %10.2f us\n", updates ? cpu / updates * 1e6 : 0.0);
+
+	iocshCmd("linkamStats " BENCH_PORT);
+	epicsExit(0);
+	return 0;
+}
@@ -0,0 +1,132 @@
+//
+// Checks of the port driver against the SDK stand-in, through the asyn interfaces records use.
+// Connects a driver to an emulated tensile stage the way linkamBench does.
+//
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <iocsh.h>
+#include <asynDriver.h>
+#include <asynFloat64SyncIO.h>
+#include <asynInt32SyncIO.h>
+#include <asynOctetSyncIO.h>
+#include <string.h>
+#include "linkamT96.h"
+
+void linkamRegistrar(void);
+void linkamSimRegistrar(void);
+
+#define TEST_PORT "TEST"
+// Ports bound to two controllers on the simulated USB bus, named after their serial numbers
+#define TEST_USB_A "SIMUSBA"
+#define TEST_USB_B "SIMUSBB"
+// Timeout of each request (s)
+#define TEST_TIMEOUT 5.0
+
+static asynUser *connectFloat64(const char *param)
+{
+	asynUser *pasynUser = NULL;
+
+	if (pasynFloat64SyncIO->connect(TEST_PORT, 0, &pasynUser, param) != asynSuccess)
+		testAbort("cannot connect to %s %s", TEST_PORT, param);
+	return pasynUser;
+}
+
+static asynUser *connectInt32(const char *param)
+{
+	asynUser *pasynUser = NULL;
+
+	if (pasynInt32SyncIO->connect(TEST_PORT, 0, &pasynUser, param) != asynSuccess)
+		testAbort("cannot connect to %s %s", TEST_PORT, param);
+	return pasynUser;
+}
+
+static epicsInt32 readInt32(asynUser *pasynUser)
+{
+	epicsInt32 value = -1;
+
+	pasynInt32SyncIO->read(pasynUser, &value, TEST_TIMEOUT);
+	return value;
+}
+
+//
+// Two ports opened together must each come up on their own controller, whichever of their
+// connected events the SDK raises first.
+//
+static void testParallelConnect(void)
+{
+	const char *ports[] = { TEST_USB_A, TEST_USB_B };
+	char serial[64];
+	asynUser *pasynUser;
+	size_t nRead;
+	int i, eomReason;
+
+	for (i = 0; i < 2; i++) {
+		serial[0] = '\0';
+		if (pasynOctetSyncIO->connect(ports[i], 0, &pasynUser, P_SerialString) != asynSuccess)
+			testAbort("cannot connect to %s %s", ports[i], P_SerialString);
+		pasynOctetSyncIO->read(pasynUser, serial, sizeof(serial) - 1, TEST_TIMEOUT, &nRead, &eomReason);
+		testOk(strcmp(serial, ports[i]) == 0, "%s bound to controller '%s'", ports[i], serial);
+	}
+}
+
+//
+// A setting read only at connect must still show a successful write of it at once.
+//
+static void testWriteRefresh(void)
+{
+	asynUser *setpointSet = connectFloat64(P_SetpointSetString);
+	asynUser *setpoint = connectFloat64(P_SetpointString);
+	double value = 0.0, waited;
+
+	testOk1(pasynFloat64SyncIO->write(setpointSet, 42.5, TEST_TIMEOUT) == asynSuccess);
+	for (waited = 0; value != 42.5 && waited < 1.0; waited += 0.1) {
+		epicsThreadSleep(0.1);
+		pasynFloat64SyncIO->read(setpoint, &value, TEST_TIMEOUT);
+	}
+	testOk(value == 42.5, "setpoint read back as %g", value);
+}
+
+//
+// A position move through TSTP:VAL, the way the motion records drive the stage, must fill
+// the stress-strain capture until the motor stops at the distance setpoint.
+//
+static void testMoveCapture(void)
+{
+	asynUser *velocity = connectFloat64(P_TstpVeloString);
+	asynUser *position = connectFloat64(P_TstpValString);
+	asynUser *count = connectInt32(P_TstCapCountString);
+	asynUser *done = connectInt32(P_TstCapDoneString);
+	epicsInt32 samples;
+	double waited;
+
+	testOk1(pasynFloat64SyncIO->write(velocity, 1000.0, TEST_TIMEOUT) == asynSuccess);
+	// From the closed jaws, a 1 mm move at 1 mm/s
+	testOk1(pasynFloat64SyncIO->write(position, 16000.0, TEST_TIMEOUT) == asynSuccess);
+	for (waited = 0; readInt32(done) != 1 && waited < TEST_TIMEOUT; waited += 0.1)
+		epicsThreadSleep(0.1);
+	samples = readInt32(count);
+	testOk(readInt32(done) == 1, "capture ended with the move");
+	testOk(samples > 1, "%d capture samples", samples);
+}
+
+MAIN(linkamDriverTest)
+{
+	testPlan(8);
+
+	linkamRegistrar();
+	linkamSimRegistrar();
+	iocshCmd("linkamSimUSBDevice " TEST_USB_A " 0");
+	iocshCmd("linkamSimUSBDevice " TEST_USB_B " 0");
+	iocshCmd("linkamConnect " TEST_PORT " \"\" /dev/null \"\" 50 50 \"\" 1 tensile 0 0");
+	iocshCmd("linkamConnect " TEST_USB_A " \"\" /dev/null \"\" 50 50 \"\" 1 \"\" 0 0 " TEST_USB_A);
+	iocshCmd("linkamConnect " TEST_USB_B " \"\" /dev/null \"\" 50 50 \"\" 1 \"\" 0 0 " TEST_USB_B);
+	iocshCmd("linkamPollGroup " TEST_PORT " once 0 " P_SetpointString);
+	// Let the drivers finish their first full poll
+	epicsThreadSleep(1.0);
+
+	testParallelConnect();
+	testWriteRefresh();
+	testMoveCapture();
+	return testDone();
+}
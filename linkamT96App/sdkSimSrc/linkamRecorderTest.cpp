@@ -0,0 +1,161 @@
+//
+// Round trip through the recorder and replay: a run written by linkamRecorder, small enough
+// to roll over twice, is played back by linkamReplay into a channel list of a different order,
+// with a channel the run does not have and without one that it does.
+//
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "linkamRecorder.h"
+#include "linkamReplay.h"
+
+#define TEST_CHANNELS 3
+#define TEST_RECORDS 25
+// Records that fit in each file of the run
+#define TEST_FILE_RECORDS 10
+// Longest wait for the writer and replay threads (s)
+#define TEST_TIMEOUT 10.0
+
+// Replay channels: C and A from the run, X that was never recorded
+#define REPLAY_C 0
+#define REPLAY_X 1
+#define REPLAY_A 2
+
+// Channel c of record i as pushed; C is only read on even records
+static double testValue(int i, int c)
+{
+	return i * 10.0 + c + 0.5;
+}
+
+static uint64_t testValidMask(int i)
+{
+	return i % 2 == 0 ? 0x7 : 0x3;
+}
+
+struct ReplayCheck
+{
+	linkamReplay *replay;
+	int samples;
+	int mismatches;
+	epicsEventId done;
+};
+
+// Outlive main, the writer and replay threads run until the process exits
+static linkamRecorder *recorder;
+static linkamReplay *replay;
+static ReplayCheck replayCheck;
+
+// Called from the replay thread once each record has been applied, status is its index
+static void checkSample(void *pvt, uint64_t status)
+{
+	ReplayCheck *check = (ReplayCheck *)pvt;
+	int i = (int)status;
+	double a, c, x;
+
+	if (check->samples >= TEST_RECORDS)
+		return;
+	// C holds its last recorded value over the records where it was not read
+	if (!check->replay->value(REPLAY_A, &a) || a != testValue(i, 0) ||
+	    !check->replay->value(REPLAY_C, &c) || c != testValue(i - i % 2, 2) ||
+	    check->replay->value(REPLAY_X, &x) || i != check->samples) {
+		testDiag("record %d replayed out of order or with the wrong values", i);
+		check->mismatches++;
+	}
+	if (++check->samples == TEST_RECORDS)
+		epicsEventSignal(check->done);
+}
+
+static size_t fileSizeOf(const char *path)
+{
+	struct stat info;
+
+	return stat(path, &info) == 0 ? (size_t)info.st_size : 0;
+}
+
+MAIN(linkamRecorderTest)
+{
+	std::vector<std::string> recorded, replayed;
+	char dir[] = "/tmp/linkamRecorderTestXXXXXX";
+	char baseName[256], fileName[256];
+	double values[TEST_CHANNELS];
+	size_t headerSize, recordSize, lastSize;
+	epicsTimeStamp start, time;
+	int i, c, files;
+	double waited;
+
+	testPlan(8);
+
+	recorded.push_back("A");
+	recorded.push_back("B");
+	recorded.push_back("C");
+	replayed.push_back("C");
+	replayed.push_back("X");
+	replayed.push_back("A");
+
+	if (!mkdtemp(dir))
+		testAbort("cannot create a directory for the run");
+	snprintf(baseName, sizeof(baseName), "%s/run", dir);
+
+	// The file layout documented in linkamRecorder.h
+	headerSize = (sizeof(LinkamRecorderHeader) + TEST_CHANNELS * LINKAM_RECORDER_NAME_LEN + 7) & ~(size_t)7;
+	recordSize = sizeof(LinkamRecordHeader) + TEST_CHANNELS * sizeof(double);
+
+	recorder = new linkamRecorder("test", recorded);
+	recorder->setFileSize(headerSize + TEST_FILE_RECORDS * recordSize);
+	testOk1(recorder->start(baseName));
+
+	epicsTimeGetCurrent(&start);
+	for (i = 0; i < TEST_RECORDS; i++) {
+		time = start;
+		epicsTimeAddSeconds(&time, i * 0.001);
+		for (c = 0; c < TEST_CHANNELS; c++)
+			values[c] = testValue(i, c);
+		if (!recorder->push(&time, i, testValidMask(i), values))
+			testDiag("record %d dropped", i);
+	}
+	recorder->stop();
+
+	// The last file is trimmed to its records once the writer thread has closed it
+	snprintf(fileName, sizeof(fileName), "%s_%04u.bin", baseName, 2);
+	lastSize = headerSize + (TEST_RECORDS - 2 * TEST_FILE_RECORDS) * recordSize;
+	for (waited = 0; fileSizeOf(fileName) != lastSize && waited < TEST_TIMEOUT; waited += 0.01)
+		epicsThreadSleep(0.01);
+	testOk(recorder->recorded() == TEST_RECORDS, "%lu records written", recorder->recorded());
+	testOk(recorder->dropped() == 0, "%lu records dropped", recorder->dropped());
+	testOk(fileSizeOf(fileName) == lastSize, "last file trimmed to its records");
+
+	for (files = 0; ; files++) {
+		snprintf(fileName, sizeof(fileName), "%s_%04u.bin", baseName, files);
+		if (fileSizeOf(fileName) == 0)
+			break;
+	}
+	testOk(files == 3, "run rolled over into %d files", files);
+
+	replay = new linkamReplay(baseName, 1000.0, replayed);
+	testOk1(replay->open());
+
+	replayCheck.replay = replay;
+	replayCheck.samples = 0;
+	replayCheck.mismatches = 0;
+	replayCheck.done = epicsEventMustCreate(epicsEventEmpty);
+	replay->start(checkSample, &replayCheck);
+	testOk(epicsEventWaitWithTimeout(replayCheck.done, TEST_TIMEOUT) == epicsEventWaitOK, "whole run replayed");
+	testOk(replayCheck.mismatches == 0, "replayed values matched to their channels by name");
+
+	for (i = 0; i < files; i++) {
+		snprintf(fileName, sizeof(fileName), "%s_%04u.bin", baseName, i);
+		unlink(fileName);
+	}
+	rmdir(dir);
+
+	return testDone();
+}
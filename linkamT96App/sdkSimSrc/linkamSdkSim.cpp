@@ -0,0 +1,1011 @@
+//
+// Stand-in for the closed Linkam SDK (libLinkamSDK.so). Implements the library functions
+// declared in LinkamSDK.h on top of a simple stage model, so the driver can be built and
+// benchmarked without a controller, a licence file or libusb. Every message can be given a
+// latency, a random jitter and a failure rate with linkamSimFault to reproduce slow or
+// unreliable links; a reply later than the connection's Rx timeout fails at the timeout, as
+// it would in the SDK. linkamSimUSBDevice puts controllers on a simulated USB bus, to exercise
+// discovery and binding by serial number; a non-blocking open waits for its controller to
+// be added there. linkamSimUnplug takes one off the bus for a while, to exercise reconnection.
+//
+#include <epicsExport.h>
+#include <epicsMutex.h>
+#include <epicsStdlib.h>
+#include <epicsString.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <iocsh.h>
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "include/LinkamSDK.h"
+#include "linkamVariant.h"
+
+static const char *driverName = "linkamSdkSim";
+
+#define LINKAM_SIM_VERSION "sim-1.0"
+// SDK default period of the data thread that raises new-value callbacks (ms)
+#define LINKAM_SIM_DATA_RATE 100
+#define LINKAM_SIM_AMBIENT 25.0
+// Heater power (%) per degree of error, and how fast an idle stage drifts to ambient (1/s)
+#define LINKAM_SIM_POWER_GAIN 10.0
+#define LINKAM_SIM_COOLING 0.02
+// Linkam USB vendor and T96 product IDs reported for the simulated controllers
+#define LINKAM_SIM_VENDOR_ID 0x16DA
+#define LINKAM_SIM_PRODUCT_ID 0x0002
+// Tensile stage: closed jaw gap and sample stiffness (N/um)
+#define LINKAM_SIM_JAW_ZERO 15000.0
+#define LINKAM_SIM_STIFFNESS 0.01
+
+// Injected behaviour of one message code
+struct SimFault
+{
+	double latency;         // Fixed delay (s)
+	double jitter;          // Extra delay up to this much, uniformly distributed (s)
+	double failureRate;     // Fraction of messages that fail, 0-1
+};
+
+// One emulated controller and stage
+struct SimStage
+{
+	LinkamSDK::StageType type;
+	bool lnp;
+	bool humidity;
+	bool tensile;
+	bool heating;
+	bool motorRunning;
+	bool lnpAuto;
+	double holdTime;        // Hold at setpoint (s)
+	double holdRemaining;
+	int dataRate;           // ms
+	double rxTimeout;       // Longest wait for a reply before a message fails (s), 0 for no limit
+	double sampleWidth;     // Tensile sample size (um)
+	double sampleThickness;
+	epicsTimeStamp lastStep;
+	std::string serial;     // Controller serial number
+	std::map<int, double> values; // Indexed by StageValueType
+};
+
+// A controller on the simulated USB bus
+struct SimUSBDevice
+{
+	std::string serial;
+	LinkamSDK::StageType type;
+	CommsHandle handle;     // Open connection to it, 0 if none
+};
+
+// A connection opened with OpenCommsNonBlocking, waiting for its controller
+struct SimPendingOpen
+{
+	LinkamSDK::CommsInfo info;
+	CommsHandle handle;     // Given to the request when it was made
+};
+
+static epicsMutexId simMutex;
+static std::map<CommsHandle, SimStage *> stages;
+static CommsHandle nextHandle = 1;
+static std::map<unsigned int, SimFault> faults;
+static SimFault defaultFault = { 0.0, 0.0, 0.0 };
+static unsigned int randomState = 1;
+static std::vector<EventNewValueCallback> newValueCallbacks;
+static std::vector<EventCallback> connectedCallbacks;
+static std::vector<EventCallback> disconnectedCallbacks;
+static std::vector<EventErrorCallback> errorCallbacks;
+static std::vector<EventLogCallback> logCallbacks;
+static std::vector<EventStageEventCallback> eventCallbacks;
+static bool dataThreadStarted = false;
+// One standard stage until linkamSimUSBDevice sets the bus up
+static std::vector<SimUSBDevice> usbDevices;
+static bool usbDevicesConfigured = false;
+
+// Variant member each stage value travels in, as the real SDK documents it
+static LinkamValueKind valueKind(int type)
+{
+	switch (type) {
+	case LinkamSDK::eStageValueTypeDsc:
+		return LINKAM_VALUE_UINT32;
+	case LinkamSDK::eStageValueTypeTstTableDirection:
+	case LinkamSDK::eStageValueTypeTstStrainEngineeringUnits:
+	case LinkamSDK::eStageValueTypeTstStrainPercentage:
+	case LinkamSDK::eStageValueTypeTstShowAsForceDistance:
+	case LinkamSDK::eStageValueTypeTstIsJawMonitorEnabled:
+		return LINKAM_VALUE_BOOLEAN;
+	case LinkamSDK::eStageValueTypeTstTableMode:
+		return LINKAM_VALUE_TST_MODE;
+	case LinkamSDK::eStageValueTypeTstStatus:
+		return LINKAM_VALUE_TST_STATUS;
+	case LinkamSDK::eStageValueTypeTstCycleCountLimit:
+	case LinkamSDK::eStageValueTypeTstCyclesRemaining:
+		return LINKAM_VALUE_INT32;
+	default:
+		return LINKAM_VALUE_FLOAT32;
+	}
+}
+
+// Uniform random number in [0, 1), reproducible from run to run
+static double simRandom(void)
+{
+	randomState = randomState * 1103515245 + 12345;
+	return ((randomState >> 8) & 0xFFFFFF) / (double)0x1000000;
+}
+
+static SimStage *newStage(LinkamSDK::StageType type, bool lnp, bool humidity)
+{
+	SimStage *stage = new SimStage;
+
+	stage->type = type;
+	stage->lnp = lnp;
+	stage->humidity = humidity;
+	stage->tensile = type == LinkamSDK::eStageType_TensileTest || type == LinkamSDK::eStageType_TensileTestV2;
+	stage->heating = false;
+	stage->motorRunning = false;
+	stage->lnpAuto = true;
+	stage->holdTime = 0.0;
+	stage->holdRemaining = 0.0;
+	stage->dataRate = LINKAM_SIM_DATA_RATE;
+	stage->rxTimeout = 0.0;
+	stage->sampleWidth = 0.0;
+	stage->sampleThickness = 0.0;
+	epicsTimeGetCurrent(&stage->lastStep);
+	stage->serial = "SIM00001";
+
+	stage->values[LinkamSDK::eStageValueTypeHeater1Temp] = LINKAM_SIM_AMBIENT;
+	stage->values[LinkamSDK::eStageValueTypeHeaterRate] = 10.0;
+	stage->values[LinkamSDK::eStageValueTypeHeaterSetpoint] = LINKAM_SIM_AMBIENT;
+	stage->values[LinkamSDK::eStageValueTypeHeater1Power] = 0.0;
+	stage->values[LinkamSDK::eStageValueTypeHeater1LNPSpeed] = 0.0;
+	stage->values[LinkamSDK::eStageValueTypeRampHoldRemaining] = 0.0;
+	if (type == LinkamSDK::eStageType_DifferentialScanningCalorimetry ||
+	    type == LinkamSDK::eStageType_DifferentialScanningCalorimetryV2)
+		stage->values[LinkamSDK::eStageValueTypeDsc] = 0.0;
+	if (type == LinkamSDK::eStageType_Vacuum || type == LinkamSDK::eStageType_ThermocoupledVacuum) {
+		stage->values[LinkamSDK::eStageValueTypeVacuum] = 1000.0;
+		stage->values[LinkamSDK::eStageValueTypeVacuumOptionBoardSensor1Data] = 1000.0;
+	}
+	if (stage->tensile) {
+		stage->values[LinkamSDK::eStageValueTypeTstRawMotorPos] = LINKAM_SIM_JAW_ZERO;
+		stage->values[LinkamSDK::eStageValueTypeTstMotorPos] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstJawPosition] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstJawToJawSize] = LINKAM_SIM_JAW_ZERO;
+		stage->values[LinkamSDK::eStageValueTypeTstMotorVel] = 100.0;
+		stage->values[LinkamSDK::eStageValueTypeMotorTstDefaultSpeed] = 100.0;
+		stage->values[LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstMinExtentPosition] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstMaxExtentPosition] = 80000.0;
+		stage->values[LinkamSDK::eStageValueTypeTstForce] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstForceSetpoint] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstForceGauge] = 200.0;
+		stage->values[LinkamSDK::eStageValueTypeTstStrain] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstStress] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstPidKp] = 1.0;
+		stage->values[LinkamSDK::eStageValueTypeTstPidKi] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstPidKd] = 0.0;
+		stage->values[LinkamSDK::eStageValueTypeTstTableDirection] = 0;
+		stage->values[LinkamSDK::eStageValueTypeTstTableMode] = LinkamSDK::eTSTMode_Stop;
+		stage->values[LinkamSDK::eStageValueTypeTstStrainEngineeringUnits] = 0;
+		stage->values[LinkamSDK::eStageValueTypeTstStrainPercentage] = 0;
+		stage->values[LinkamSDK::eStageValueTypeTstShowAsForceDistance] = 0;
+		stage->values[LinkamSDK::eStageValueTypeTstIsJawMonitorEnabled] = 1;
+		stage->values[LinkamSDK::eStageValueTypeTstCycleCountLimit] = 0;
+		stage->values[LinkamSDK::eStageValueTypeTstCyclesRemaining] = 0;
+		stage->values[LinkamSDK::eStageValueTypeTstStatus] = 0;
+	}
+	return stage;
+}
+
+//
+// \brief     Advance the stage model to now. Called with simMutex held.
+//
+static void stepStage(SimStage *stage)
+{
+	std::map<int, double> &v = stage->values;
+	epicsTimeStamp now;
+	double dt, temp, setpoint, rate, error, pos, target, step, extension;
+	LinkamSDK::TSTStatus tstStatus;
+
+	epicsTimeGetCurrent(&now);
+	dt = epicsTimeDiffInSeconds(&now, &stage->lastStep);
+	stage->lastStep = now;
+	if (dt <= 0)
+		return;
+
+	// Ramp at the heater rate to the setpoint and hold there, otherwise drift to ambient
+	temp = v[LinkamSDK::eStageValueTypeHeater1Temp];
+	setpoint = v[LinkamSDK::eStageValueTypeHeaterSetpoint];
+	rate = v[LinkamSDK::eStageValueTypeHeaterRate] / 60.0;
+	if (stage->heating) {
+		error = setpoint - temp;
+		step = rate * dt;
+		temp = fabs(error) <= step ? setpoint : temp + (error > 0 ? step : -step);
+		if (temp == setpoint && stage->holdRemaining > 0)
+			stage->holdRemaining = std::max(0.0, stage->holdRemaining - dt);
+		v[LinkamSDK::eStageValueTypeHeater1Power] = std::min(100.0, std::max(0.0, (setpoint - LINKAM_SIM_AMBIENT) * 0.2 +
+		                                                                          error * LINKAM_SIM_POWER_GAIN));
+		if (stage->lnp)
+			v[LinkamSDK::eStageValueTypeHeater1LNPSpeed] = temp < LINKAM_SIM_AMBIENT || error < 0 ? 50.0 : 0.0;
+	} else {
+		temp += (LINKAM_SIM_AMBIENT - temp) * std::min(1.0, LINKAM_SIM_COOLING * dt);
+		v[LinkamSDK::eStageValueTypeHeater1Power] = 0.0;
+		v[LinkamSDK::eStageValueTypeHeater1LNPSpeed] = 0.0;
+	}
+	v[LinkamSDK::eStageValueTypeHeater1Temp] = temp;
+	v[LinkamSDK::eStageValueTypeRampHoldRemaining] = stage->holdRemaining;
+	if (v.count(LinkamSDK::eStageValueTypeDsc))
+		v[LinkamSDK::eStageValueTypeDsc] = stage->heating ? rate * 0.5 : 0.0;
+
+	if (!stage->tensile)
+		return;
+
+	// Move the jaws at the motor velocity; step mode stops at the distance setpoint,
+	// velocity mode at the travel limits
+	pos = v[LinkamSDK::eStageValueTypeTstRawMotorPos];
+	if (stage->motorRunning) {
+		step = v[LinkamSDK::eStageValueTypeTstMotorVel] * dt;
+		if ((int)v[LinkamSDK::eStageValueTypeTstTableDirection])
+			step = -step;
+		target = pos + step;
+		if ((int)v[LinkamSDK::eStageValueTypeTstTableMode] == LinkamSDK::eTSTMode_Step) {
+			double remaining = v[LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint];
+			if (fabs(step) >= remaining) {
+				target = pos + (step < 0 ? -remaining : remaining);
+				stage->motorRunning = false;
+			}
+			v[LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint] = std::max(0.0, remaining - fabs(step));
+		}
+		if (target <= LINKAM_SIM_JAW_ZERO + v[LinkamSDK::eStageValueTypeTstMinExtentPosition]) {
+			target = LINKAM_SIM_JAW_ZERO + v[LinkamSDK::eStageValueTypeTstMinExtentPosition];
+			stage->motorRunning = false;
+		} else if (target >= LINKAM_SIM_JAW_ZERO + v[LinkamSDK::eStageValueTypeTstMaxExtentPosition]) {
+			target = LINKAM_SIM_JAW_ZERO + v[LinkamSDK::eStageValueTypeTstMaxExtentPosition];
+			stage->motorRunning = false;
+		}
+		pos = target;
+	}
+	extension = pos - LINKAM_SIM_JAW_ZERO;
+	v[LinkamSDK::eStageValueTypeTstRawMotorPos] = pos;
+	v[LinkamSDK::eStageValueTypeTstMotorPos] = extension;
+	v[LinkamSDK::eStageValueTypeTstJawPosition] = extension;
+	v[LinkamSDK::eStageValueTypeTstForce] = extension * LINKAM_SIM_STIFFNESS;
+	v[LinkamSDK::eStageValueTypeTstStrain] = extension / v[LinkamSDK::eStageValueTypeTstJawToJawSize] * 100.0;
+	v[LinkamSDK::eStageValueTypeTstStress] = extension * LINKAM_SIM_STIFFNESS;
+
+	tstStatus.value = 0;
+	tstStatus.flags.zeroLimit = extension <= v[LinkamSDK::eStageValueTypeTstMinExtentPosition];
+	tstStatus.flags.refLimit = extension >= v[LinkamSDK::eStageValueTypeTstMaxExtentPosition];
+	tstStatus.flags.moveDone = !stage->motorRunning;
+	tstStatus.flags.dirn = (int)v[LinkamSDK::eStageValueTypeTstTableDirection] != 0;
+	v[LinkamSDK::eStageValueTypeTstStatus] = tstStatus.value;
+}
+
+static LinkamSDK::ControllerStatus stageStatus(const SimStage *stage)
+{
+	LinkamSDK::ControllerStatus status;
+	std::map<int, double>::const_iterator temp = stage->values.find(LinkamSDK::eStageValueTypeHeater1Temp);
+	std::map<int, double>::const_iterator setpoint = stage->values.find(LinkamSDK::eStageValueTypeHeaterSetpoint);
+
+	status.value = 0;
+	status.flags.heater1Started = stage->heating;
+	status.flags.heater1RampSetPoint = stage->heating && temp->second == setpoint->second;
+	status.flags.lnpCoolingPumpAuto = stage->lnp && stage->lnpAuto;
+	status.flags.lnpCoolingPumpOn = stage->lnp && stage->values.find(LinkamSDK::eStageValueTypeHeater1LNPSpeed)->second > 0;
+	status.flags.motorStoppedZ = !stage->motorRunning;
+	return status;
+}
+
+//
+// \brief     Stands in for the SDK data thread: steps every stage and raises the new-value
+//            callbacks at the fastest data rate asked for.
+//
+static void dataThread(void *)
+{
+	std::vector<std::pair<CommsHandle, LinkamSDK::ControllerStatus> > updates;
+	std::vector<EventNewValueCallback> callbacks;
+	std::map<CommsHandle, SimStage *>::iterator it;
+	size_t i, j;
+	int period;
+
+	while (true) {
+		updates.clear();
+		period = 1000;
+		epicsMutexLock(simMutex);
+		for (it = stages.begin(); it != stages.end(); ++it) {
+			stepStage(it->second);
+			updates.push_back(std::make_pair(it->first, stageStatus(it->second)));
+			period = std::min(period, it->second->dataRate);
+		}
+		callbacks = newValueCallbacks;
+		epicsMutexUnlock(simMutex);
+
+		for (i = 0; i < updates.size(); i++) {
+			for (j = 0; j < callbacks.size(); j++)
+				callbacks[j](updates[i].first, updates[i].second);
+		}
+		epicsThreadSleep(period / 1000.0);
+	}
+}
+
+static void startSim(void)
+{
+	SimUSBDevice device;
+
+	if (!simMutex) {
+		simMutex = epicsMutexMustCreate();
+		device.serial = "SIM00001";
+		device.type = LinkamSDK::eStageType_Standard;
+		device.handle = 0;
+		usbDevices.push_back(device);
+	}
+	if (!dataThreadStarted) {
+		dataThreadStarted = true;
+		epicsThreadCreate("linkamSdkSim", epicsThreadPriorityMedium,
+		                  epicsThreadGetStackSize(epicsThreadStackMedium),
+		                  (EPICSTHREADFUNC)dataThread, NULL);
+	}
+}
+
+//
+// \brief     Delay the caller as configured for the message, then decide whether it fails.
+//            A reply later than the connection's Rx timeout is given up on at the timeout.
+// \return    false if the message is to fail.
+//
+static bool injectFault(unsigned int msg, double rxTimeout)
+{
+	std::map<unsigned int, SimFault>::const_iterator it;
+	SimFault fault;
+	double delay;
+	bool fail;
+
+	epicsMutexLock(simMutex);
+	it = faults.find(msg);
+	fault = it != faults.end() ? it->second : defaultFault;
+	delay = fault.latency + fault.jitter * simRandom();
+	fail = fault.failureRate > 0 && simRandom() < fault.failureRate;
+	epicsMutexUnlock(simMutex);
+
+	if (rxTimeout > 0 && delay > rxTimeout) {
+		delay = rxTimeout;
+		fail = true;
+	}
+
+	if (delay > 0)
+		epicsThreadSleep(delay);
+	return !fail;
+}
+
+static bool copyString(LinkamSDK::Variant param1, LinkamSDK::Variant param2, const char *value)
+{
+	if (!param1.vPtr || param2.vUint32 == 0)
+		return false;
+	strncpy((char *)param1.vPtr, value, param2.vUint32);
+	((char *)param1.vPtr)[param2.vUint32 - 1] = '\0';
+	return true;
+}
+
+//
+// \brief     The USB controller a connection asks for, the only one on the bus if no serial
+//            number is given. Sets the error flags the SDK would if there is none to open.
+//            Called with simMutex held.
+//
+static SimUSBDevice *findUSBDevice(const char *serial, LinkamSDK::ConnectionStatus *status)
+{
+	SimUSBDevice *device = NULL;
+	size_t i;
+
+	if (!serial[0]) {
+		if (usbDevices.size() > 1)
+			status->flags.errorMultipleDevicesFound = 1;
+		else if (!usbDevices.empty())
+			device = &usbDevices[0];
+	} else {
+		for (i = 0; i < usbDevices.size() && usbDevices[i].serial != serial; i++)
+			;
+		if (i < usbDevices.size())
+			device = &usbDevices[i];
+	}
+	if (!device && !status->flags.errorMultipleDevicesFound)
+		status->flags.errorNoDeviceFound = 1;
+	if (device && device->handle) {
+		status->flags.errorAlreadyOpen = 1;
+		device = NULL;
+	}
+	return device;
+}
+
+static bool discoverUSBDevices(LinkamSDK::Variant *result, LinkamSDK::Variant param1, LinkamSDK::Variant param2)
+{
+	LinkamSDK::USBDeviceInfo *list = (LinkamSDK::USBDeviceInfo *)param1.vPtr;
+	size_t i;
+
+	epicsMutexLock(simMutex);
+	result->vUint32 = list ? std::min((uint32_t)usbDevices.size(), param2.vUint32) : 0;
+	for (i = 0; i < result->vUint32; i++) {
+		memset(&list[i], 0, sizeof(list[i]));
+		list[i].vendorID = LINKAM_SIM_VENDOR_ID;
+		list[i].productID = LINKAM_SIM_PRODUCT_ID;
+		strncpy(list[i].serialNumber, usbDevices[i].serial.c_str(), sizeof(list[i].serialNumber) - 1);
+		strncpy(list[i].manufacturerName, "Linkam Scientific (sim)", sizeof(list[i].manufacturerName) - 1);
+		strncpy(list[i].productName, "T96 (sim)", sizeof(list[i].productName) - 1);
+	}
+	epicsMutexUnlock(simMutex);
+	return true;
+}
+
+//
+// \brief     Open a connection and raise the connected event for it. A non-blocking request
+//            passes the handle it was assigned, a blocking one is given the next free handle.
+//
+static bool openComms(LinkamSDK::Variant *result, LinkamSDK::Variant param1, LinkamSDK::Variant param2,
+                      CommsHandle assigned = 0)
+{
+	LinkamSDK::CommsInfo *info = (LinkamSDK::CommsInfo *)param1.vPtr;
+	std::vector<EventCallback> callbacks;
+	CommsHandle handle;
+	SimStage *stage;
+	size_t i;
+
+	result->vConnectionStatus.value = 0;
+	if (!info || !param2.vPtr) {
+		result->vConnectionStatus.flags.errorPropertiesIncorrect = 1;
+		return true;
+	}
+	epicsMutexLock(simMutex);
+	if (info->type == LinkamSDK::eCommsTypeEmulator) {
+		LinkamSDK::EmulatorInfo *emulator = (LinkamSDK::EmulatorInfo *)info->info;
+		stage = newStage((LinkamSDK::StageType)emulator->stageType, emulator->haveLNP, emulator->haveHumidity);
+	} else if (info->type == LinkamSDK::eCommsTypeUSB) {
+		SimUSBDevice *device = findUSBDevice(((LinkamSDK::USBCommsInfo *)info->info)->serialNumber,
+		                                     &result->vConnectionStatus);
+		if (!device) {
+			epicsMutexUnlock(simMutex);
+			return true;
+		}
+		stage = newStage(device->type, true, false);
+		stage->serial = device->serial;
+		stage->rxTimeout = ((LinkamSDK::USBCommsInfo *)info->info)->timeout / 1000.0;
+		device->handle = assigned ? assigned : nextHandle;
+	} else {
+		// Anything on a serial port looks like a standard stage with an LNP
+		stage = newStage(LinkamSDK::eStageType_Standard, true, false);
+		stage->rxTimeout = ((LinkamSDK::SerialCommsInfo *)info->info)->timeout / 1000.0;
+	}
+	handle = assigned ? assigned : nextHandle++;
+	stages[handle] = stage;
+	callbacks = connectedCallbacks;
+	epicsMutexUnlock(simMutex);
+
+	*(CommsHandle *)param2.vPtr = handle;
+	result->vConnectionStatus.flags.connected = 1;
+	for (i = 0; i < callbacks.size(); i++)
+		callbacks[i](handle);
+	return true;
+}
+
+//
+// \brief     Complete a non-blocking open. The delay configured for OpenCommsNonBlocking is the
+//            time the controller takes to appear; a USB controller that is not on the bus is
+//            waited for, any other error drops the request, as it would time out in the SDK.
+//
+static void pendingOpenTask(void *pvt)
+{
+	SimPendingOpen *pending = (SimPendingOpen *)pvt;
+	LinkamSDK::Variant result, param1, param2;
+
+	param1.vPtr = &pending->info;
+	param2.vPtr = &pending->handle;
+	while (true) {
+		if (injectFault(LinkamSDK::eLinkamFunctionMsgCode_OpenCommsNonBlocking, 0.0)) {
+			openComms(&result, param1, param2, pending->handle);
+			if (!result.vConnectionStatus.flags.errorNoDeviceFound)
+				break;
+		}
+		epicsThreadSleep(1.0);
+	}
+	delete pending;
+}
+
+//
+// \brief     Accept a connection request and return at once with the handle it is assigned,
+//            the connected callbacks report that handle once pendingOpenTask has opened it.
+//            The event may come before the request has returned.
+//
+static bool openCommsNonBlocking(LinkamSDK::Variant *result, LinkamSDK::Variant param1, LinkamSDK::Variant param2)
+{
+	SimPendingOpen *pending;
+
+	result->vConnectionStatus.value = 0;
+	if (!param1.vPtr || !param2.vPtr) {
+		result->vConnectionStatus.flags.errorPropertiesIncorrect = 1;
+		return true;
+	}
+	pending = new SimPendingOpen;
+	pending->info = *(LinkamSDK::CommsInfo *)param1.vPtr;
+	epicsMutexLock(simMutex);
+	pending->handle = nextHandle++;
+	epicsMutexUnlock(simMutex);
+	*(CommsHandle *)param2.vPtr = pending->handle;
+	epicsThreadCreate("linkamSimOpen", epicsThreadPriorityMedium,
+	                  epicsThreadGetStackSize(epicsThreadStackSmall),
+	                  (EPICSTHREADFUNC)pendingOpenTask, pending);
+	return true;
+}
+
+static bool closeComms(CommsHandle hDevice, LinkamSDK::Variant *result)
+{
+	std::vector<EventCallback> callbacks;
+	size_t i;
+	bool found;
+
+	epicsMutexLock(simMutex);
+	found = stages.count(hDevice) > 0;
+	if (found) {
+		delete stages[hDevice];
+		stages.erase(hDevice);
+	}
+	for (i = 0; i < usbDevices.size(); i++) {
+		if (usbDevices[i].handle == hDevice)
+			usbDevices[i].handle = 0;
+	}
+	callbacks = disconnectedCallbacks;
+	epicsMutexUnlock(simMutex);
+
+	for (i = 0; found && i < callbacks.size(); i++)
+		callbacks[i](hDevice);
+	result->vBoolean = found;
+	return found;
+}
+
+//
+// \brief     Answer a message for one stage. Called with simMutex held.
+//
+static bool stageMessage(SimStage *stage, LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant *result,
+                         LinkamSDK::Variant param1, LinkamSDK::Variant param2)
+{
+	std::map<int, double> &v = stage->values;
+	std::map<int, double>::iterator it;
+	int type;
+
+	result->vUint64 = 0;
+	switch (msg) {
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStatus:
+		stepStage(stage);
+		result->vControllerStatus = stageStatus(stage);
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetValue:
+		type = param1.vStageValueType;
+		if (type == LinkamSDK::eStageValueTypeTstSampleSize && stage->tensile) {
+			result->vTSTSampleSize.width = (float)stage->sampleWidth;
+			result->vTSTSampleSize.thickness = (float)stage->sampleThickness;
+			return true;
+		}
+		it = v.find(type);
+		if (it == v.end())
+			return false;
+		linkamSetVariantValue(*result, valueKind(type), it->second);
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_SetValue:
+		type = param1.vStageValueType;
+		if (type == LinkamSDK::eStageValueTypeRampHoldTime) {
+			stage->holdTime = stage->holdRemaining = param2.vFloat32;
+		} else if (type == LinkamSDK::eStageValueTypeTstSampleSize) {
+			if (!stage->tensile)
+				return false;
+			stage->sampleWidth = param2.vTSTSampleSize.width;
+			stage->sampleThickness = param2.vTSTSampleSize.thickness;
+		} else if (type == LinkamSDK::eStageValueTypeTstEnableJawMonitor ||
+		           type == LinkamSDK::eStageValueTypeTstDisableJawMonitor) {
+			v[LinkamSDK::eStageValueTypeTstIsJawMonitorEnabled] = type == LinkamSDK::eStageValueTypeTstEnableJawMonitor;
+		} else if (v.count(type)) {
+			v[type] = linkamVariantValue(param2, valueKind(type));
+		} else {
+			return false;
+		}
+		result->vBoolean = true;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_StartHeating:
+		stage->heating = param1.vBoolean;
+		stage->holdRemaining = stage->holdTime;
+		result->vBoolean = true;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_LnpSetMode:
+		stage->lnpAuto = param1.vBoolean;
+		result->vBoolean = stage->lnp;
+		return stage->lnp;
+	case LinkamSDK::eLinkamFunctionMsgCode_LnpSetSpeed:
+		if (stage->lnp)
+			v[LinkamSDK::eStageValueTypeHeater1LNPSpeed] = param1.vUint32;
+		result->vBoolean = stage->lnp;
+		return stage->lnp;
+	case LinkamSDK::eLinkamFunctionMsgCode_TstSetMode:
+		if (!stage->tensile)
+			return false;
+		v[LinkamSDK::eStageValueTypeTstTableMode] = param1.vTSTMode;
+		if (param1.vTSTMode == LinkamSDK::eTSTMode_Stop)
+			stage->motorRunning = false;
+		result->vBoolean = true;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_StartMotors:
+		if (!stage->tensile)
+			return false;
+		stage->motorRunning = param1.vBoolean;
+		result->vBoolean = true;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_TstZeroPosition:
+	case LinkamSDK::eLinkamFunctionMsgCode_TstCalibrateDistance:
+		if (!stage->tensile)
+			return false;
+		v[LinkamSDK::eStageValueTypeTstRawMotorPos] = LINKAM_SIM_JAW_ZERO;
+		result->vBoolean = true;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_TstZeroForce:
+		result->vBoolean = stage->tensile;
+		return stage->tensile;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerError:
+		result->vControllerError = LinkamSDK::eControllerErrorNone;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerConfig:
+		result->vControllerConfig.flags.supportsHeater = 1;
+		result->vControllerConfig.flags.lnpReady = stage->lnp;
+		result->vControllerConfig.flags.humidityReady = stage->humidity;
+		result->vControllerConfig.flags.tensileMotorCardReady = stage->tensile;
+		result->vControllerConfig.flags.tensileForceCardReady = stage->tensile;
+		result->vControllerConfig.flags.dscCardReady = v.count(LinkamSDK::eStageValueTypeDsc) > 0;
+		result->vControllerConfig.flags.vacuumOption = v.count(LinkamSDK::eStageValueTypeVacuum) > 0;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageConfig:
+		result->vStageConfig.flags.standardStage = !stage->tensile;
+		result->vStageConfig.flags.tensileStage = stage->tensile;
+		result->vStageConfig.flags.dscStage = v.count(LinkamSDK::eStageValueTypeDsc) > 0;
+		result->vStageConfig.flags.supportsVacuum = v.count(LinkamSDK::eStageValueTypeVacuum) > 0;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageType:
+		result->vStageType = stage->type;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetOptionCardType:
+		// No option cards fitted
+		return false;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetDataRate:
+		result->vUint32 = stage->dataRate;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_SetDataRate:
+		stage->dataRate = std::min(1000u, std::max(5u, param1.vUint32));
+		result->vBoolean = true;
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerName:
+		return copyString(param1, param2, stage->tensile ? "T96-M (sim)" : "T96-S (sim)");
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerSerial:
+		return copyString(param1, param2, stage->serial.c_str());
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageName:
+		return copyString(param1, param2, stage->tensile ? "TST350 (sim)" : "THMS600 (sim)");
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageSerial:
+		return copyString(param1, param2, "SIMSTAGE1");
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerFirmwareVersion:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerHardwareVersion:
+		return copyString(param1, param2, LINKAM_SIM_VERSION);
+	default:
+		return false;
+	}
+}
+
+/*
+ * Library functions from LinkamSDK.h
+ */
+
+bool linkamInitialiseSDK(const char *logpath, const char *licpath, bool initCOM)
+{
+	(void)logpath;
+	(void)licpath;
+	(void)initCOM;
+	startSim();
+	printf("%s: Linkam SDK stand-in, no hardware is used\n", driverName);
+	return true;
+}
+
+void linkamExitSDK()
+{
+}
+
+bool linkamGetVersion(char *version, uint64_t length)
+{
+	if (!version || length == 0)
+		return false;
+	strncpy(version, LINKAM_SIM_VERSION, length);
+	version[length - 1] = '\0';
+	return true;
+}
+
+bool linkamProcessMessage(LinkamSDK::LinkamFunctionMsgCode msg, CommsHandle hDevice, LinkamSDK::Variant *result,
+                          LinkamSDK::Variant param1, LinkamSDK::Variant param2, LinkamSDK::Variant param3)
+{
+	std::map<CommsHandle, SimStage *>::iterator it;
+	double rxTimeout;
+	bool valid;
+
+	(void)param3;
+	if (!result)
+		return false;
+	startSim();
+	// The request returns at once, its latency and failures apply to the connection instead
+	if (msg == LinkamSDK::eLinkamFunctionMsgCode_OpenCommsNonBlocking)
+		return openCommsNonBlocking(result, param1, param2);
+	epicsMutexLock(simMutex);
+	it = stages.find(hDevice);
+	valid = it != stages.end();
+	rxTimeout = valid ? it->second->rxTimeout : 0.0;
+	// Kept by the SDK itself, nothing goes over the link
+	if (valid && msg == LinkamSDK::eLinkamFunctionMsgCode_SetCommsRxTimeout) {
+		it->second->rxTimeout = param1.vUint64 / 1e6;
+		result->vBoolean = true;
+	}
+	epicsMutexUnlock(simMutex);
+	if (msg == LinkamSDK::eLinkamFunctionMsgCode_SetCommsRxTimeout)
+		return valid;
+	if (!injectFault(msg, rxTimeout))
+		return false;
+
+	switch (msg) {
+	case LinkamSDK::eLinkamFunctionMsgCode_OpenComms:
+		return openComms(result, param1, param2);
+	case LinkamSDK::eLinkamFunctionMsgCode_CloseComms:
+		return closeComms(hDevice, result);
+	case LinkamSDK::eLinkamFunctionMsgCode_DiscoverUSBDeviceCount:
+		epicsMutexLock(simMutex);
+		result->vUint32 = usbDevices.size();
+		epicsMutexUnlock(simMutex);
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetUSBDeviceDetailsList:
+		return discoverUSBDevices(result, param1, param2);
+	case LinkamSDK::eLinkamFunctionMsgCode_DisableLogging:
+	case LinkamSDK::eLinkamFunctionMsgCode_EnableLogging:
+		result->vBoolean = true;
+		return true;
+	default:
+		break;
+	}
+
+	epicsMutexLock(simMutex);
+	it = stages.find(hDevice);
+	valid = it != stages.end() && stageMessage(it->second, msg, result, param1, param2);
+	epicsMutexUnlock(simMutex);
+	return valid;
+}
+
+bool linkamProcessMessageCommon(uint32_t msg, CommsHandle hDevice, void *result, uint64_t param1, uint64_t param2, uint64_t param3)
+{
+	LinkamSDK::Variant p1, p2, p3;
+
+	p1.vUint64 = param1;
+	p2.vUint64 = param2;
+	p3.vUint64 = param3;
+	return linkamProcessMessage((LinkamSDK::LinkamFunctionMsgCode)msg, hDevice, (LinkamSDK::Variant *)result, p1, p2, p3);
+}
+
+void linkamInitialiseUSBCommsInfo(LinkamSDK::CommsInfo *info, const char *serialNumber)
+{
+	LinkamSDK::USBCommsInfo *usb = (LinkamSDK::USBCommsInfo *)info->info;
+
+	memset(info, 0, sizeof(*info));
+	info->type = LinkamSDK::eCommsTypeUSB;
+	if (serialNumber)
+		strncpy(usb->serialNumber, serialNumber, sizeof(usb->serialNumber) - 1);
+	usb->timeout = 1000;
+}
+
+void linkamInitialiseUSBCommsInfoEx(LinkamSDK::CommsInfo *info, const char *serialNumber, uint32_t msgTimeout)
+{
+	linkamInitialiseUSBCommsInfo(info, serialNumber);
+	((LinkamSDK::USBCommsInfo *)info->info)->timeout = msgTimeout;
+}
+
+void linkamInitialiseSerialCommsInfo(LinkamSDK::CommsInfo *info, const char *port)
+{
+	LinkamSDK::SerialCommsInfo *serial = (LinkamSDK::SerialCommsInfo *)info->info;
+
+	memset(info, 0, sizeof(*info));
+	info->type = LinkamSDK::eCommsTypeSerial;
+	if (port)
+		strncpy(serial->port, port, sizeof(serial->port) - 1);
+	serial->baudrate = 115200;
+	serial->timeout = 1000;
+	serial->portTimeout = 5;
+}
+
+void linkamInitialiseSerialCommsInfoEx(LinkamSDK::CommsInfo *info, const char *port, uint32_t msgTimeout, uint32_t portTimeout)
+{
+	linkamInitialiseSerialCommsInfo(info, port);
+	((LinkamSDK::SerialCommsInfo *)info->info)->timeout = msgTimeout;
+	((LinkamSDK::SerialCommsInfo *)info->info)->portTimeout = portTimeout;
+}
+
+void linkamInitialiseEmulatedCommsInfo(LinkamSDK::CommsInfo *info, LinkamSDK::StageType type, bool supportLNP, bool supportRH)
+{
+	LinkamSDK::EmulatorInfo *emulator = (LinkamSDK::EmulatorInfo *)info->info;
+
+	memset(info, 0, sizeof(*info));
+	info->type = LinkamSDK::eCommsTypeEmulator;
+	emulator->stageType = type;
+	emulator->haveLNP = supportLNP;
+	emulator->haveHumidity = supportRH;
+}
+
+template <class T> static void addCallback(std::vector<T> &callbacks, T callback)
+{
+	startSim();
+	epicsMutexLock(simMutex);
+	if (callback && std::find(callbacks.begin(), callbacks.end(), callback) == callbacks.end())
+		callbacks.push_back(callback);
+	epicsMutexUnlock(simMutex);
+}
+
+template <class T> static void removeCallback(std::vector<T> &callbacks, T callback)
+{
+	startSim();
+	epicsMutexLock(simMutex);
+	callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), callback), callbacks.end());
+	epicsMutexUnlock(simMutex);
+}
+
+void linkamSetCallbackNewValue(EventNewValueCallback callback) { addCallback(newValueCallbacks, callback); }
+void linkamSetCallbackControllerConnected(EventCallback callback) { addCallback(connectedCallbacks, callback); }
+void linkamSetCallbackControllerDisconnected(EventCallback callback) { addCallback(disconnectedCallbacks, callback); }
+void linkamSetCallbackError(EventErrorCallback callback) { addCallback(errorCallbacks, callback); }
+void linkamSetCallbackLog(EventLogCallback callback) { addCallback(logCallbacks, callback); }
+void linkamSetCallbackEvent(EventStageEventCallback callback) { addCallback(eventCallbacks, callback); }
+void linkamRemoveCallbackNewValue(EventNewValueCallback callback) { removeCallback(newValueCallbacks, callback); }
+void linkamRemoveCallbackControllerConnected(EventCallback callback) { removeCallback(connectedCallbacks, callback); }
+void linkamRemoveCallbackControllerDisconnected(EventCallback callback) { removeCallback(disconnectedCallbacks, callback); }
+void linkamRemoveCallbackError(EventErrorCallback callback) { removeCallback(errorCallbacks, callback); }
+void linkamRemoveCallbackLog(EventLogCallback callback) { removeCallback(logCallbacks, callback); }
+void linkamRemoveCallbackEvent(EventStageEventCallback callback) { removeCallback(eventCallbacks, callback); }
+
+/*
+ * linkamSimFault
+ */
+static const iocshArg linkamSimFault_Arg0 = { "msgCode|all", iocshArgString };
+static const iocshArg linkamSimFault_Arg1 = { "latencyMs", iocshArgDouble };
+static const iocshArg linkamSimFault_Arg2 = { "jitterMs", iocshArgDouble };
+static const iocshArg linkamSimFault_Arg3 = { "failurePercent", iocshArgDouble };
+static const iocshArg * const linkamSimFault_Args[] = { &linkamSimFault_Arg0, &linkamSimFault_Arg1, &linkamSimFault_Arg2, &linkamSimFault_Arg3 };
+static const iocshFuncDef linkamSimFault_FuncDef = { "linkamSimFault", 4, linkamSimFault_Args };
+
+static void linkamSimFault_CallFunc(const iocshArgBuf *args)
+{
+	SimFault fault;
+	long msg;
+
+	if (!args[0].sval) {
+		printf("Usage: linkamSimFault msgCode|all latencyMs jitterMs failurePercent\n");
+		return;
+	}
+
+	fault.latency = std::max(0.0, args[1].dval) / 1000.0;
+	fault.jitter = std::max(0.0, args[2].dval) / 1000.0;
+	fault.failureRate = std::min(100.0, std::max(0.0, args[3].dval)) / 100.0;
+
+	startSim();
+	epicsMutexLock(simMutex);
+	if (epicsStrCaseCmp(args[0].sval, "all") == 0) {
+		// Applies to every message without a setting of its own
+		defaultFault = fault;
+	} else if (epicsParseLong(args[0].sval, &msg, 0, NULL) == 0) {
+		faults[(unsigned int)msg] = fault;
+	} else {
+		printf("linkamSimFault: '%s' is not a message code (e.g. 0x25) or all\n", args[0].sval);
+	}
+	epicsMutexUnlock(simMutex);
+}
+
+/*
+ * linkamSimUSBDevice
+ */
+static const iocshArg linkamSimUSBDevice_Arg0 = { "serialNumber", iocshArgString };
+static const iocshArg linkamSimUSBDevice_Arg1 = { "tensile", iocshArgInt };
+static const iocshArg * const linkamSimUSBDevice_Args[] = { &linkamSimUSBDevice_Arg0, &linkamSimUSBDevice_Arg1 };
+static const iocshFuncDef linkamSimUSBDevice_FuncDef = { "linkamSimUSBDevice", 2, linkamSimUSBDevice_Args };
+
+static void linkamSimUSBDevice_CallFunc(const iocshArgBuf *args)
+{
+	SimUSBDevice device;
+
+	if (!args[0].sval || !args[0].sval[0]) {
+		printf("Usage: linkamSimUSBDevice serialNumber tensile\n");
+		return;
+	}
+	device.serial = std::string(args[0].sval).substr(0, sizeof(((LinkamSDK::USBDeviceInfo *)0)->serialNumber) - 1);
+	device.type = args[1].ival ? LinkamSDK::eStageType_TensileTest : LinkamSDK::eStageType_Standard;
+	device.handle = 0;
+
+	startSim();
+	epicsMutexLock(simMutex);
+	// The first controller added replaces the default one
+	if (!usbDevicesConfigured) {
+		usbDevices.clear();
+		usbDevicesConfigured = true;
+	}
+	usbDevices.push_back(device);
+	epicsMutexUnlock(simMutex);
+}
+
+/*
+ * linkamSimUnplug
+ */
+static const iocshArg linkamSimUnplug_Arg0 = { "serialNumber", iocshArgString };
+static const iocshArg linkamSimUnplug_Arg1 = { "seconds", iocshArgDouble };
+static const iocshArg * const linkamSimUnplug_Args[] = { &linkamSimUnplug_Arg0, &linkamSimUnplug_Arg1 };
+static const iocshFuncDef linkamSimUnplug_FuncDef = { "linkamSimUnplug", 2, linkamSimUnplug_Args };
+
+// A controller off the bus, and for how long (s)
+struct SimUnplugged
+{
+	SimUSBDevice device;
+	double seconds;
+};
+
+static void replugTask(void *pvt)
+{
+	SimUnplugged *unplugged = (SimUnplugged *)pvt;
+
+	epicsThreadSleep(unplugged->seconds);
+	epicsMutexLock(simMutex);
+	usbDevices.push_back(unplugged->device);
+	epicsMutexUnlock(simMutex);
+	printf("%s: %s plugged back in\n", driverName, unplugged->device.serial.c_str());
+	delete unplugged;
+}
+
+//
+// \brief     Take a USB controller off the bus, as a bumped cable would: its connection is
+//            closed, raising the disconnected event, and it comes back after the given time.
+//
+static void linkamSimUnplug_CallFunc(const iocshArgBuf *args)
+{
+	SimUnplugged *unplugged;
+	LinkamSDK::Variant result;
+	CommsHandle handle;
+	size_t i;
+
+	if (!args[0].sval || !args[0].sval[0]) {
+		printf("Usage: linkamSimUnplug serialNumber seconds\n");
+		return;
+	}
+	startSim();
+	epicsMutexLock(simMutex);
+	for (i = 0; i < usbDevices.size() && usbDevices[i].serial != args[0].sval; i++)
+		;
+	if (i == usbDevices.size()) {
+		epicsMutexUnlock(simMutex);
+		printf("linkamSimUnplug: no USB controller %s\n", args[0].sval);
+		return;
+	}
+	unplugged = new SimUnplugged;
+	unplugged->device = usbDevices[i];
+	unplugged->device.handle = 0;
+	unplugged->seconds = args[1].dval > 0 ? args[1].dval : 0.0;
+	handle = usbDevices[i].handle;
+	usbDevices.erase(usbDevices.begin() + i);
+	epicsMutexUnlock(simMutex);
+
+	if (handle)
+		closeComms(handle, &result);
+	epicsThreadCreate("linkamSimReplug", epicsThreadPriorityMedium,
+	                  epicsThreadGetStackSize(epicsThreadStackSmall),
+	                  (EPICSTHREADFUNC)replugTask, unplugged);
+}
+
+/*
+ * iocshRegister
+ */
+
+void linkamSimRegistrar(void)
+{
+	iocshRegister(&linkamSimFault_FuncDef, linkamSimFault_CallFunc);
+	iocshRegister(&linkamSimUSBDevice_FuncDef, linkamSimUSBDevice_CallFunc);
+	iocshRegister(&linkamSimUnplug_FuncDef, linkamSimUnplug_CallFunc);
+}
+
+extern "C" {
+	epicsExportRegistrar(linkamSimRegistrar);
+}
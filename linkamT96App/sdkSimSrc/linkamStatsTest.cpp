@@ -0,0 +1,99 @@
+//
+// Checks of the latency histograms: every bin starts where the one below it ends, and the
+// percentiles of a known set of calls land on the bins they were recorded into.
+//
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include "linkamStats.h"
+
+// Bins the calls are recorded into, wide enough that the time taken to record does not
+// move a call out of its bin
+#define TEST_FAST_BIN 32
+#define TEST_SLOW_BIN 44
+#define TEST_STALL_BIN 56
+
+static uint64_t limitNs(int bin)
+{
+	return (uint64_t)llround(linkamStats::binLimit(bin) * 1e6);
+}
+
+// Record a call that took the middle of a bin
+static void recordCall(linkamStats &stats, LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant param1,
+                       int bin, bool ok)
+{
+	stats.record(msg, param1, linkamStats::now() - (limitNs(bin - 1) + limitNs(bin)) / 2, ok);
+}
+
+static void testBinEdges(void)
+{
+	int bin, wrong = 0;
+
+	for (bin = 0; bin < LINKAM_STATS_BINS - 1; bin++) {
+		// The last microsecond below a bin's limit is in it, the limit itself in the next one
+		if (linkamStats::bin(limitNs(bin) - 1000) != bin || linkamStats::bin(limitNs(bin)) != bin + 1) {
+			testDiag("bin %d ends at %g ms", bin, linkamStats::binLimit(bin));
+			wrong++;
+		}
+	}
+	testOk(wrong == 0, "bins are contiguous");
+	testOk1(linkamStats::bin(0) == 0);
+	testOk1(linkamStats::bin(999) == 0);
+	testOk1(linkamStats::bin(4000) == 4);
+	testOk1(linkamStats::bin(UINT64_MAX / 2) == LINKAM_STATS_BINS - 1);
+}
+
+static void testPercentiles(void)
+{
+	std::vector<linkamStats::Summary> summaries;
+	LinkamSDK::Variant param1, none;
+	linkamStats stats;
+	int i;
+
+	param1.vUint64 = 0;
+	param1.vStageValueType = LinkamSDK::eStageValueTypeHeater1Temp;
+	none.vUint64 = 0;
+
+	// 90 fast calls, 8 slow ones and 2 stalls that fail
+	for (i = 0; i < 90; i++)
+		recordCall(stats, LinkamSDK::eLinkamFunctionMsgCode_GetValue, param1, TEST_FAST_BIN, true);
+	for (i = 0; i < 8; i++)
+		recordCall(stats, LinkamSDK::eLinkamFunctionMsgCode_GetValue, param1, TEST_SLOW_BIN, true);
+	for (i = 0; i < 2; i++)
+		recordCall(stats, LinkamSDK::eLinkamFunctionMsgCode_GetValue, param1, TEST_STALL_BIN, false);
+	recordCall(stats, LinkamSDK::eLinkamFunctionMsgCode_GetStatus, none, TEST_FAST_BIN, true);
+
+	stats.summarise(summaries);
+	testOk(summaries.size() == 2, "%d histograms in use", (int)summaries.size());
+	if (summaries.size() != 2) {
+		testSkip(7, "wrong histograms");
+		return;
+	}
+
+	// GetValue slots come before the other messages
+	const linkamStats::Summary &value = summaries[0];
+	testOk(value.msgCode == LinkamSDK::eLinkamFunctionMsgCode_GetValue &&
+	       value.valueType == LinkamSDK::eStageValueTypeHeater1Temp, "GetValue kept per value type");
+	testOk(value.calls == 100 && value.failures == 2, "%g calls, %g failed", value.calls, value.failures);
+	testOk(value.p50 == linkamStats::binLimit(TEST_FAST_BIN), "p50 %g ms", value.p50);
+	testOk(value.p95 == linkamStats::binLimit(TEST_SLOW_BIN), "p95 %g ms", value.p95);
+	// Capped at the slowest call, which is below the limit of its bin
+	testOk(value.p99 == value.max && value.max > linkamStats::binLimit(TEST_STALL_BIN - 1) &&
+	       value.max < linkamStats::binLimit(TEST_STALL_BIN), "p99 %g ms, max %g ms", value.p99, value.max);
+	testOk(summaries[1].msgCode == LinkamSDK::eLinkamFunctionMsgCode_GetStatus && summaries[1].valueType == -1,
+	       "other messages kept per code");
+
+	stats.reset();
+	stats.summarise(summaries);
+	testOk(summaries.empty(), "reset clears every histogram");
+}
+
+MAIN(linkamStatsTest)
+{
+	testPlan(13);
+	testBinEdges();
+	testPercentiles();
+	return testDone();
+}
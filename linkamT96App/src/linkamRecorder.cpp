@@ -0,0 +1,313 @@
+#include <epicsThread.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "linkamRecorder.h"
+
+static const char *driverName = "linkamRecorder";
+
+// Default size each file is pre-extended to before it rolls over (bytes)
+#define LINKAM_RECORDER_FILE_SIZE (256 * 1024 * 1024)
+// Samples buffered between the acquisition and writer threads (bytes)
+#define LINKAM_RECORDER_BUFFER_SIZE (4 * 1024 * 1024)
+// Period at which the writer thread flushes the mapping while recording (s)
+#define LINKAM_RECORDER_FLUSH_PERIOD 1.0
+
+static void writerTaskC(void *drvPvt)
+{
+	linkamRecorder *pRecorder = (linkamRecorder *)drvPvt;
+	pRecorder->writerTask();
+}
+
+linkamRecorder::linkamRecorder(const char *name, const std::vector<std::string> &channels)
+	: name(name), channels(channels)
+{
+	if (this->channels.size() > LINKAM_RECORDER_MAX_CHANNELS) {
+		printf("%s: %s: only the first %d of %d channels are recorded\n", driverName, name,
+		       LINKAM_RECORDER_MAX_CHANNELS, (int)this->channels.size());
+		this->channels.resize(LINKAM_RECORDER_MAX_CHANNELS);
+	}
+	recordSize = sizeof(LinkamRecordHeader) + this->channels.size() * sizeof(double);
+	headerSize = sizeof(LinkamRecorderHeader) + this->channels.size() * LINKAM_RECORDER_NAME_LEN;
+	// Keep records 8 byte aligned in the mapping
+	headerSize = (headerSize + 7) & ~(size_t)7;
+	fileSize = LINKAM_RECORDER_FILE_SIZE;
+	pushBuffer.resize(recordSize);
+	discardBuffer.resize(recordSize);
+
+	ring = epicsRingBytesCreate(LINKAM_RECORDER_BUFFER_SIZE);
+	wakeEvent = epicsEventMustCreate(epicsEventEmpty);
+	mutex = epicsMutexMustCreate();
+
+	startPending = false;
+	stopPending = false;
+	busy = false;
+	active = false;
+	recordCount = 0;
+	dropCount = 0;
+	fd = -1;
+	map = NULL;
+	mapSize = 0;
+	capacity = 0;
+	fileRecords = 0;
+	fileIndex = 0;
+	runFileSize = fileSize;
+
+	if (epicsThreadCreate("linkamRecorder",
+	                      epicsThreadPriorityLow,
+	                      epicsThreadGetStackSize(epicsThreadStackMedium),
+	                      (EPICSTHREADFUNC)writerTaskC,
+	                      this) == NULL) {
+		printf("%s: epicsThreadCreate failure for writer task\n", driverName);
+	}
+}
+
+//
+// \brief     Set the size files are pre-extended to. Takes effect from the next start().
+//
+void linkamRecorder::setFileSize(size_t bytes)
+{
+	epicsMutexLock(mutex);
+	fileSize = std::max(bytes, headerSize + recordSize);
+	epicsMutexUnlock(mutex);
+}
+
+//
+// \brief     Start a run writing to <baseName>_NNNN.bin. The files are opened by the writer
+//            thread, so a failure to open them shows up as recording() going false.
+// \return    false if a run is in progress or still closing, or no file name was given.
+//
+bool linkamRecorder::start(const char *baseName)
+{
+	bool started = false;
+
+	epicsMutexLock(mutex);
+	if (!baseName || !baseName[0]) {
+		printf("%s: %s: no file name to record to\n", driverName, name.c_str());
+	} else if (busy) {
+		printf("%s: %s: previous recording has not finished\n", driverName, name.c_str());
+	} else {
+		this->baseName = baseName;
+		runFileSize = fileSize;
+		recordCount = 0;
+		dropCount = 0;
+		busy = true;
+		startPending = true;
+		active = true;
+		started = true;
+	}
+	epicsMutexUnlock(mutex);
+
+	if (started)
+		epicsEventSignal(wakeEvent);
+	return started;
+}
+
+//
+// \brief     Stop accepting samples. The writer thread writes out what is buffered and then
+//            trims and closes the file.
+//
+void linkamRecorder::stop(void)
+{
+	epicsMutexLock(mutex);
+	if (active) {
+		active = false;
+		stopPending = true;
+	}
+	epicsMutexUnlock(mutex);
+
+	epicsEventSignal(wakeEvent);
+}
+
+//
+// \brief     Queue a sample for the writer thread. Never blocks: the sample is dropped if the
+//            ring buffer is full. Only one thread may push.
+// \param[in] values        One value per channel.
+// \return    true if the sample was queued.
+//
+bool linkamRecorder::push(const epicsTimeStamp *time, uint64_t status, uint64_t validMask, const double *values)
+{
+	LinkamRecordHeader *header = (LinkamRecordHeader *)&pushBuffer[0];
+
+	if (!active)
+		return false;
+
+	header->secPastEpoch = time->secPastEpoch;
+	header->nsec = time->nsec;
+	header->status = status;
+	header->validMask = validMask;
+	memcpy(&pushBuffer[sizeof(LinkamRecordHeader)], values, channels.size() * sizeof(double));
+
+	// Puts all of the record or none of it
+	if (epicsRingBytesPut(ring, &pushBuffer[0], recordSize) == 0) {
+		dropCount++;
+		return false;
+	}
+	epicsEventSignal(wakeEvent);
+	return true;
+}
+
+void linkamRecorder::currentFile(char *buffer, size_t size)
+{
+	epicsMutexLock(mutex);
+	strncpy(buffer, fileName.c_str(), size);
+	buffer[size - 1] = '\0';
+	epicsMutexUnlock(mutex);
+}
+
+void linkamRecorder::report(FILE *fp)
+{
+	char file[256];
+
+	currentFile(file, sizeof(file));
+	fprintf(fp, "  Recorder %s, %d channels, %d byte records, file size %lu MB\n",
+	        active ? "recording" : "idle", (int)channels.size(), (int)recordSize,
+	        (unsigned long)(fileSize / (1024 * 1024)));
+	if (file[0])
+		fprintf(fp, "    file %s, %lu records, %lu dropped\n", file, recordCount, dropCount);
+}
+
+//
+// \brief     Writer thread. Moves records from the ring buffer straight into the mapped file
+//            and handles start, stop and rollover.
+//
+void linkamRecorder::writerTask(void)
+{
+	bool startRun, stopRun;
+
+	while (true) {
+		epicsEventWaitWithTimeout(wakeEvent, LINKAM_RECORDER_FLUSH_PERIOD);
+
+		epicsMutexLock(mutex);
+		startRun = startPending;
+		stopRun = stopPending;
+		startPending = false;
+		stopPending = false;
+		epicsMutexUnlock(mutex);
+
+		if (startRun) {
+			fileIndex = 0;
+			if (!openFile())
+				active = false;
+		}
+
+		drain();
+
+		if (stopRun || (map == NULL && !active)) {
+			closeFile();
+			epicsMutexLock(mutex);
+			// Unless a new run was started once this one stopped
+			if (!startPending)
+				busy = false;
+			epicsMutexUnlock(mutex);
+		} else if (map) {
+			// Let the kernel start writing back, without waiting for it
+			msync(map, mapSize, MS_ASYNC);
+		}
+	}
+}
+
+//
+// \brief     Copy queued records into the file, rolling over to the next one when it is full.
+//            Records queued while no file is open are discarded.
+//
+void linkamRecorder::drain(void)
+{
+	LinkamRecorderHeader *header;
+
+	while (epicsRingBytesUsedBytes(ring) >= (int)recordSize) {
+		if (map && fileRecords >= capacity) {
+			closeFile();
+			fileIndex++;
+			if (!openFile())
+				active = false;
+		}
+		if (map == NULL) {
+			// A run that has just started gets its file on the next pass
+			if (active)
+				break;
+			epicsRingBytesGet(ring, &discardBuffer[0], recordSize);
+			continue;
+		}
+		epicsRingBytesGet(ring, map + headerSize + fileRecords * recordSize, recordSize);
+		fileRecords++;
+		recordCount++;
+		header = (LinkamRecorderHeader *)map;
+		header->numRecords = fileRecords;
+	}
+}
+
+//
+// \brief     Create the next file of the run, pre-extend it to the file size and map it.
+//
+bool linkamRecorder::openFile(void)
+{
+	LinkamRecorderHeader *header;
+	char path[1024];
+	size_t i;
+	int err;
+
+	epicsMutexLock(mutex);
+	snprintf(path, sizeof(path), "%s_%04u.bin", baseName.c_str(), fileIndex);
+	fileName = path;
+	epicsMutexUnlock(mutex);
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("%s: %s: cannot create %s: %s\n", driverName, name.c_str(), path, strerror(errno));
+		return false;
+	}
+	// Allocate the blocks up front so writes through the mapping cannot fail for lack of space
+	err = posix_fallocate(fd, 0, runFileSize);
+	if (err != 0) {
+		printf("%s: %s: cannot allocate %lu bytes for %s: %s\n", driverName, name.c_str(),
+		       (unsigned long)runFileSize, path, strerror(err));
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	map = (char *)mmap(NULL, runFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		printf("%s: %s: cannot map %s: %s\n", driverName, name.c_str(), path, strerror(errno));
+		map = NULL;
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	mapSize = runFileSize;
+	capacity = (mapSize - headerSize) / recordSize;
+	fileRecords = 0;
+
+	header = (LinkamRecorderHeader *)map;
+	memcpy(header->magic, LINKAM_RECORDER_MAGIC, sizeof(header->magic));
+	header->headerSize = headerSize;
+	header->recordSize = recordSize;
+	header->numChannels = channels.size();
+	header->fileIndex = fileIndex;
+	header->numRecords = 0;
+	for (i = 0; i < channels.size(); i++)
+		strncpy(map + sizeof(LinkamRecorderHeader) + i * LINKAM_RECORDER_NAME_LEN, channels[i].c_str(),
+		        LINKAM_RECORDER_NAME_LEN - 1);
+	return true;
+}
+
+//
+// \brief     Flush the mapping, then trim the file to the records actually written.
+//
+void linkamRecorder::closeFile(void)
+{
+	if (map == NULL)
+		return;
+	msync(map, mapSize, MS_SYNC);
+	munmap(map, mapSize);
+	map = NULL;
+	if (ftruncate(fd, headerSize + fileRecords * recordSize) != 0)
+		printf("%s: %s: cannot trim %s: %s\n", driverName, name.c_str(), fileName.c_str(), strerror(errno));
+	close(fd);
+	fd = -1;
+}
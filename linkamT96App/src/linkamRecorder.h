@@ -0,0 +1,99 @@
+#ifndef LINKAM_RECORDER_H
+#define LINKAM_RECORDER_H
+
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsRingBytes.h>
+#include <epicsTime.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define LINKAM_RECORDER_MAGIC    "LNKREC1"
+#define LINKAM_RECORDER_NAME_LEN 40
+// Most channels a record can flag as valid
+#define LINKAM_RECORDER_MAX_CHANNELS 64
+
+//
+// File layout: a LinkamRecorderHeader, numChannels channel names of
+// LINKAM_RECORDER_NAME_LEN characters (zero padded), then fixed size records of
+// a LinkamRecordHeader followed by numChannels doubles. Host byte order.
+//
+struct LinkamRecorderHeader
+{
+	char magic[8];
+	uint32_t headerSize;    // Offset of the first record
+	uint32_t recordSize;
+	uint32_t numChannels;
+	uint32_t fileIndex;     // Position of this file in a rolled over run
+	uint64_t numRecords;    // Records written, kept up to date while recording
+};
+
+struct LinkamRecordHeader
+{
+	uint32_t secPastEpoch;  // Acquisition time, EPICS epoch
+	uint32_t nsec;
+	uint64_t status;        // Controller status flags (ControllerStatus.value)
+	uint64_t validMask;     // Bit n set if channel n was read from the controller for this sample
+};
+
+//
+// \brief     Appends samples to memory mapped, pre-extended binary files, rolling over to a new
+//            file when one fills. push() only copies the sample into a ring buffer and a writer
+//            thread moves it into the file, so the acquisition thread never waits on the disk.
+//            Samples that find the ring full are dropped and counted.
+//
+class linkamRecorder
+{
+public:
+	linkamRecorder(const char *name, const std::vector<std::string> &channels);
+	void setFileSize(size_t bytes);
+	bool start(const char *baseName);
+	void stop(void);
+	bool push(const epicsTimeStamp *time, uint64_t status, uint64_t validMask, const double *values);
+	bool recording(void) const { return active; }
+	unsigned long recorded(void) const { return recordCount; }
+	unsigned long dropped(void) const { return dropCount; }
+	void currentFile(char *buffer, size_t size);
+	void report(FILE *fp);
+	void writerTask(void);
+
+private:
+	bool openFile(void);
+	void closeFile(void);
+	void drain(void);
+
+	std::string name;
+	std::vector<std::string> channels;
+	size_t recordSize;
+	size_t headerSize;
+	size_t fileSize;
+	std::vector<char> pushBuffer;       // Acquisition thread only
+	epicsRingBytesId ring;
+	epicsEventId wakeEvent;
+	epicsMutexId mutex;                 // Guards the requests and file name below
+
+	// Requests from the port thread, taken by the writer thread
+	bool startPending;
+	bool stopPending;
+	bool busy;                          // A run has not finished closing yet
+	std::string baseName;
+	std::string fileName;
+
+	volatile bool active;
+	volatile unsigned long recordCount;
+	volatile unsigned long dropCount;
+
+	// Owned by the writer thread
+	std::vector<char> discardBuffer;
+	int fd;
+	char *map;
+	size_t mapSize;
+	uint64_t capacity;
+	uint64_t fileRecords;
+	unsigned int fileIndex;
+	size_t runFileSize;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include <epicsThread.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "linkamReplay.h"
+
+static const char *driverName = "linkamReplay";
+
+// Pause between passes of a run whose samples all carry the same time (s)
+#define LINKAM_REPLAY_WRAP_PERIOD 0.1
+
+static void replayTaskC(void *drvPvt)
+{
+	linkamReplay *pReplay = (linkamReplay *)drvPvt;
+	pReplay->replayTask();
+}
+
+//
+// \param[in] path          A recorded file, or the base name of a rolled over run (<path>_NNNN.bin).
+// \param[in] speed         Replay speed factor, 1 for the original timing.
+// \param[in] channels      Driver channel names, recorded channels are matched to them by name.
+//
+linkamReplay::linkamReplay(const char *path, double speed, const std::vector<std::string> &channels)
+	: path(path), channels(channels)
+{
+	this->speed = speed > 0 ? speed : 1.0;
+	totalRecords = 0;
+	callback = NULL;
+	callbackPvt = NULL;
+	mutex = epicsMutexMustCreate();
+	latest.assign(channels.size(), 0.0);
+	latestValid.assign(channels.size(), false);
+	latestStatus = 0;
+	replayed = 0;
+	passes = 0;
+}
+
+//
+// \brief     Map the files of the run.
+// \return    false if no records could be found.
+//
+bool linkamReplay::open(void)
+{
+	struct stat info;
+	char fileName[1024];
+	unsigned int index;
+
+	if (stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+		openSegment(path.c_str());
+	} else {
+		for (index = 0; ; index++) {
+			snprintf(fileName, sizeof(fileName), "%s_%04u.bin", path.c_str(), index);
+			if (stat(fileName, &info) != 0 || !openSegment(fileName))
+				break;
+		}
+	}
+
+	if (totalRecords == 0) {
+		printf("%s: no recorded samples found in %s\n", driverName, path.c_str());
+		return false;
+	}
+	printf("%s: %lu samples in %d file(s) from %s at %gx speed\n", driverName,
+	       (unsigned long)totalRecords, (int)segments.size(), path.c_str(), speed);
+	return true;
+}
+
+bool linkamReplay::openSegment(const char *fileName)
+{
+	const LinkamRecorderHeader *header;
+	struct stat info;
+	Segment segment;
+	char name[LINKAM_RECORDER_NAME_LEN];
+	size_t i, j;
+	int fd;
+
+	fd = ::open(fileName, O_RDONLY);
+	if (fd < 0) {
+		printf("%s: cannot open %s: %s\n", driverName, fileName, strerror(errno));
+		return false;
+	}
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(LinkamRecorderHeader)) {
+		printf("%s: %s is too short to be a recording\n", driverName, fileName);
+		close(fd);
+		return false;
+	}
+	segment.mapSize = info.st_size;
+	segment.map = (const char *)mmap(NULL, segment.mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (segment.map == MAP_FAILED) {
+		printf("%s: cannot map %s: %s\n", driverName, fileName, strerror(errno));
+		return false;
+	}
+
+	header = (const LinkamRecorderHeader *)segment.map;
+	segment.headerSize = header->headerSize;
+	segment.recordSize = header->recordSize;
+	if (memcmp(header->magic, LINKAM_RECORDER_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->numChannels > LINKAM_RECORDER_MAX_CHANNELS ||
+	    segment.headerSize < sizeof(LinkamRecorderHeader) + header->numChannels * LINKAM_RECORDER_NAME_LEN ||
+	    segment.headerSize > segment.mapSize ||
+	    segment.recordSize != sizeof(LinkamRecordHeader) + header->numChannels * sizeof(double)) {
+		printf("%s: %s is not a Linkam recording\n", driverName, fileName);
+		munmap((void *)segment.map, segment.mapSize);
+		return false;
+	}
+	// A run that was not stopped cleanly leaves the file at its pre-extended size
+	segment.numRecords = std::min<uint64_t>(header->numRecords,
+	                                        (segment.mapSize - segment.headerSize) / segment.recordSize);
+
+	for (i = 0; i < header->numChannels; i++) {
+		strncpy(name, segment.map + sizeof(LinkamRecorderHeader) + i * LINKAM_RECORDER_NAME_LEN, sizeof(name));
+		name[sizeof(name) - 1] = '\0';
+		for (j = 0; j < channels.size() && channels[j] != name; j++)
+			;
+		segment.channelMap.push_back(j < channels.size() ? (int)j : -1);
+	}
+
+	segment.fileName = fileName;
+	segments.push_back(segment);
+	totalRecords += segment.numRecords;
+	return true;
+}
+
+void linkamReplay::start(SampleCallback callback, void *pvt)
+{
+	this->callback = callback;
+	callbackPvt = pvt;
+	if (totalRecords == 0)
+		return;
+
+	if (epicsThreadCreate("linkamReplay",
+	                      epicsThreadPriorityMedium,
+	                      epicsThreadGetStackSize(epicsThreadStackMedium),
+	                      (EPICSTHREADFUNC)replayTaskC,
+	                      this) == NULL) {
+		printf("%s: epicsThreadCreate failure for replay task\n", driverName);
+	}
+}
+
+//
+// \brief     Latest replayed value of a driver channel.
+// \return    false if the channel has not been seen in the run yet.
+//
+bool linkamReplay::value(size_t channel, double *value)
+{
+	bool valid = false;
+
+	epicsMutexLock(mutex);
+	if (channel < latest.size() && latestValid[channel]) {
+		*value = latest[channel];
+		valid = true;
+	}
+	epicsMutexUnlock(mutex);
+	return valid;
+}
+
+uint64_t linkamReplay::status(void)
+{
+	uint64_t status;
+
+	epicsMutexLock(mutex);
+	status = latestStatus;
+	epicsMutexUnlock(mutex);
+	return status;
+}
+
+void linkamReplay::report(FILE *fp)
+{
+	fprintf(fp, "  Replaying %s at %gx speed, %lu samples in %d file(s), %lu replayed in %u passes\n",
+	        path.c_str(), speed, (unsigned long)totalRecords, (int)segments.size(), replayed, passes);
+}
+
+void linkamReplay::applyRecord(const Segment &segment, const LinkamRecordHeader *record)
+{
+	const double *values = (const double *)(record + 1);
+	size_t i;
+	int channel;
+
+	epicsMutexLock(mutex);
+	for (i = 0; i < segment.channelMap.size(); i++) {
+		channel = segment.channelMap[i];
+		if (channel < 0 || !(record->validMask & ((uint64_t)1 << i)))
+			continue;
+		latest[channel] = values[i];
+		latestValid[channel] = true;
+	}
+	latestStatus = record->status;
+	replayed++;
+	epicsMutexUnlock(mutex);
+}
+
+//
+// \brief     Replay thread. Sleeps until each record is due relative to the start of the pass,
+//            then publishes it. Records out of time order are replayed straight away.
+//
+void linkamReplay::replayTask(void)
+{
+	const LinkamRecordHeader *record;
+	epicsTimeStamp passStart, first, recordTime, now;
+	double due, delay, interval;
+	size_t seg;
+	uint64_t i;
+
+	while (true) {
+		epicsTimeGetCurrent(&passStart);
+		first.secPastEpoch = 0;
+		first.nsec = 0;
+		for (seg = 0; seg < segments.size(); seg++) {
+			const Segment &segment = segments[seg];
+
+			for (i = 0; i < segment.numRecords; i++) {
+				record = (const LinkamRecordHeader *)(segment.map + segment.headerSize + i * segment.recordSize);
+				recordTime.secPastEpoch = record->secPastEpoch;
+				recordTime.nsec = record->nsec;
+				if (first.secPastEpoch == 0 && first.nsec == 0)
+					first = recordTime;
+
+				due = epicsTimeDiffInSeconds(&recordTime, &first) / speed;
+				epicsTimeGetCurrent(&now);
+				delay = due - epicsTimeDiffInSeconds(&now, &passStart);
+				if (delay > 0)
+					epicsThreadSleep(delay);
+
+				applyRecord(segment, record);
+				if (callback)
+					callback(callbackPvt, record->status);
+			}
+		}
+		passes++;
+
+		// Leave the average sample spacing before the run starts over
+		interval = totalRecords > 1 ? epicsTimeDiffInSeconds(&recordTime, &first) / (totalRecords - 1) / speed : 0.0;
+		epicsThreadSleep(interval > 0 ? interval : LINKAM_REPLAY_WRAP_PERIOD);
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef LINKAM_REPLAY_H
+#define LINKAM_REPLAY_H
+
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "linkamRecorder.h"
+
+//
+// \brief     Plays a run written by linkamRecorder back in place of a controller. A thread of
+//            its own steps through the records at their original spacing (divided by the speed
+//            factor), keeps the latest value of every channel and reports each record through
+//            a callback, the way the SDK reports new values. The run repeats when it ends.
+//
+class linkamReplay
+{
+public:
+	typedef void (*SampleCallback)(void *pvt, uint64_t status);
+
+	linkamReplay(const char *path, double speed, const std::vector<std::string> &channels);
+	bool open(void);
+	void start(SampleCallback callback, void *pvt);
+	bool value(size_t channel, double *value);
+	uint64_t status(void);
+	const char *name(void) const { return path.c_str(); }
+	void report(FILE *fp);
+	void replayTask(void);
+
+private:
+	// One file of the run, mapped read only
+	struct Segment
+	{
+		std::string fileName;
+		const char *map;
+		size_t mapSize;
+		size_t headerSize;
+		size_t recordSize;
+		uint64_t numRecords;
+		std::vector<int> channelMap; // Driver channel for each file channel, -1 if unknown
+	};
+
+	bool openSegment(const char *fileName);
+	void applyRecord(const Segment &segment, const LinkamRecordHeader *record);
+
+	std::string path;
+	double speed;
+	std::vector<std::string> channels;
+	std::vector<Segment> segments;
+	uint64_t totalRecords;
+	SampleCallback callback;
+	void *callbackPvt;
+	epicsMutexId mutex;             // Guards the latest values below
+	std::vector<double> latest;
+	std::vector<bool> latestValid;
+	uint64_t latestStatus;
+	unsigned long replayed;
+	unsigned int passes;
+};
+
+#endif
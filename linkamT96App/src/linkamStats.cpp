@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "linkamStats.h"
+
+#define SLOT_GET_VALUE 0
+#define SLOT_SET_VALUE (SLOT_GET_VALUE + LINKAM_STATS_CODES)
+#define SLOT_MESSAGE   (SLOT_SET_VALUE + LINKAM_STATS_CODES)
+#define SLOT_OTHER     (SLOT_MESSAGE + LINKAM_STATS_CODES)
+
+linkamStats::linkamStats()
+{
+	size_t i;
+
+	for (i = 0; i < LINKAM_STATS_SLOTS; i++)
+		histograms[i] = NULL;
+}
+
+//
+// \brief     Bin for a call that took ns. Bins 0-3 are 0-3 us, above that each octave of
+//            microseconds is split into four.
+//
+int linkamStats::bin(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	int octave;
+
+	if (us < 4)
+		return (int)us;
+	for (octave = 2; (us >> (octave + 1)) != 0; octave++)
+		;
+	return std::min((octave - 1) * 4 + (int)((us >> (octave - 2)) & 3), LINKAM_STATS_BINS - 1);
+}
+
+//
+// \brief     Upper limit of a bin in ms.
+//
+double linkamStats::binLimit(int bin)
+{
+	if (bin < 4)
+		return (bin + 1) / 1000.0;
+	return (double)((uint64_t)(5 + bin % 4) << (bin / 4 - 1)) / 1000.0;
+}
+
+double linkamStats::percentile(const unsigned long *bins, unsigned long total, double fraction)
+{
+	unsigned long target = (unsigned long)ceil(total * fraction);
+	unsigned long count = 0;
+	int i;
+
+	for (i = 0; i < LINKAM_STATS_BINS; i++) {
+		count += bins[i];
+		if (count >= target)
+			return binLimit(i);
+	}
+	return binLimit(LINKAM_STATS_BINS - 1);
+}
+
+size_t linkamStats::slot(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant param1)
+{
+	if (msg == LinkamSDK::eLinkamFunctionMsgCode_GetValue && param1.vStageValueType < LINKAM_STATS_CODES)
+		return SLOT_GET_VALUE + param1.vStageValueType;
+	if (msg == LinkamSDK::eLinkamFunctionMsgCode_SetValue && param1.vStageValueType < LINKAM_STATS_CODES)
+		return SLOT_SET_VALUE + param1.vStageValueType;
+	if ((unsigned int)msg < LINKAM_STATS_CODES)
+		return SLOT_MESSAGE + msg;
+	return SLOT_OTHER;
+}
+
+void linkamStats::slotKey(size_t slot, int *msgCode, int *valueType)
+{
+	*valueType = -1;
+	if (slot < SLOT_SET_VALUE) {
+		*msgCode = LinkamSDK::eLinkamFunctionMsgCode_GetValue;
+		*valueType = slot - SLOT_GET_VALUE;
+	} else if (slot < SLOT_MESSAGE) {
+		*msgCode = LinkamSDK::eLinkamFunctionMsgCode_SetValue;
+		*valueType = slot - SLOT_SET_VALUE;
+	} else if (slot < SLOT_OTHER) {
+		*msgCode = slot - SLOT_MESSAGE;
+	} else {
+		*msgCode = -1;
+	}
+}
+
+//
+// \brief     Count a call that started at start (from now()) against its message code.
+// \param[in] param1        The call's first parameter, the stage value type for GetValue and SetValue.
+// \param[in] ok            false if linkamProcessMessage failed.
+//
+void linkamStats::record(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant param1, uint64_t start, bool ok)
+{
+	uint64_t ns = now() - start;
+	uint64_t max;
+	size_t index = slot(msg, param1);
+	Histogram *histogram = histograms[index];
+
+	if (histogram == NULL) {
+		Histogram *created = new Histogram;
+
+		memset((void *)created, 0, sizeof(*created));
+		// Another thread may have got there first, in which case use its histogram
+		if (__sync_bool_compare_and_swap(&histograms[index], (Histogram *)NULL, created)) {
+			histogram = created;
+		} else {
+			delete created;
+			histogram = histograms[index];
+		}
+	}
+
+	__sync_fetch_and_add(&histogram->bins[bin(ns)], 1);
+	__sync_fetch_and_add(&histogram->calls, 1);
+	if (!ok)
+		__sync_fetch_and_add(&histogram->failures, 1);
+	for (max = histogram->maxNs; ns > max; max = histogram->maxNs) {
+		if (__sync_bool_compare_and_swap(&histogram->maxNs, max, ns))
+			break;
+	}
+}
+
+//
+// \brief     Zero every histogram. Calls in flight may still be counted against the old totals.
+//
+void linkamStats::reset(void)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < LINKAM_STATS_SLOTS; i++) {
+		Histogram *histogram = histograms[i];
+
+		if (histogram == NULL)
+			continue;
+		for (j = 0; j < LINKAM_STATS_BINS; j++)
+			histogram->bins[j] = 0;
+		histogram->calls = 0;
+		histogram->failures = 0;
+		histogram->maxNs = 0;
+	}
+}
+
+//
+// \brief     Percentiles of every message code that has been called, in slot order.
+//
+void linkamStats::summarise(std::vector<Summary> &summaries)
+{
+	unsigned long bins[LINKAM_STATS_BINS];
+	unsigned long total;
+	Summary summary;
+	size_t i;
+	int j;
+
+	summaries.clear();
+	for (i = 0; i < LINKAM_STATS_SLOTS; i++) {
+		Histogram *histogram = histograms[i];
+
+		if (histogram == NULL || histogram->calls == 0)
+			continue;
+		total = 0;
+		for (j = 0; j < LINKAM_STATS_BINS; j++) {
+			bins[j] = histogram->bins[j];
+			total += bins[j];
+		}
+		slotKey(i, &summary.msgCode, &summary.valueType);
+		summary.calls = histogram->calls;
+		summary.failures = histogram->failures;
+		summary.max = histogram->maxNs / 1e6;
+		summary.p50 = std::min(percentile(bins, total, 0.50), summary.max);
+		summary.p95 = std::min(percentile(bins, total, 0.95), summary.max);
+		summary.p99 = std::min(percentile(bins, total, 0.99), summary.max);
+		summaries.push_back(summary);
+	}
+}
+
+void linkamStats::report(FILE *fp)
+{
+	std::vector<Summary> summaries;
+	size_t i;
+
+	summarise(summaries);
+	fprintf(fp, "  %-6s %-6s %10s %8s %10s %10s %10s %10s\n",
+	        "msg", "value", "calls", "failed", "p50 ms", "p95 ms", "p99 ms", "max ms");
+	for (i = 0; i < summaries.size(); i++) {
+		const Summary &s = summaries[i];
+
+		if (s.msgCode < 0)
+			fprintf(fp, "  %-6s ", "other");
+		else
+			fprintf(fp, "  0x%-4x ", s.msgCode);
+		if (s.valueType < 0)
+			fprintf(fp, "%-6s ", "");
+		else
+			fprintf(fp, "%-6d ", s.valueType);
+		fprintf(fp, "%10.0f %8.0f %10.3f %10.3f %10.3f %10.3f\n",
+		        s.calls, s.failures, s.p50, s.p95, s.p99, s.max);
+	}
+}
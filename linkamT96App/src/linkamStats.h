@@ -0,0 +1,75 @@
+#ifndef LINKAM_STATS_H
+#define LINKAM_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include "include/LinkamSDK.h"
+
+// Latency bins: four per octave of microseconds, the last one collects everything above ~30 s
+#define LINKAM_STATS_BINS 96
+// Message codes and stage value types given a histogram of their own
+#define LINKAM_STATS_CODES 256
+// GetValue and SetValue per value type, other messages per code, and one for anything out of range
+#define LINKAM_STATS_SLOTS (3 * LINKAM_STATS_CODES + 1)
+
+//
+// \brief     Latency histograms of the SDK calls made by one port, one per message code and,
+//            for GetValue and SetValue, one per stage value type. Callers record with atomic
+//            increments only, so the acquisition and port threads can both time their calls
+//            without taking a lock; a histogram is allocated the first time its key is seen.
+//
+class linkamStats
+{
+public:
+	// Percentiles and counts of one histogram, times in ms
+	struct Summary
+	{
+		int msgCode;
+		int valueType;          // -1 unless the message is GetValue or SetValue
+		double calls;
+		double failures;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	linkamStats();
+	static uint64_t now(void);
+	static int bin(uint64_t ns);
+	static double binLimit(int bin);
+	void record(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant param1, uint64_t start, bool ok);
+	void reset(void);
+	void summarise(std::vector<Summary> &summaries);
+	void report(FILE *fp);
+
+private:
+	struct Histogram
+	{
+		volatile unsigned long bins[LINKAM_STATS_BINS];
+		volatile unsigned long calls;
+		volatile unsigned long failures;
+		volatile uint64_t maxNs;
+	};
+
+	static double percentile(const unsigned long *bins, unsigned long total, double fraction);
+	size_t slot(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant param1);
+	void slotKey(size_t slot, int *msgCode, int *valueType);
+
+	Histogram * volatile histograms[LINKAM_STATS_SLOTS];
+};
+
+//
+// \brief     Monotonic time in ns, used to time the calls.
+//
+inline uint64_t linkamStats::now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
@@ -1,7 +1,9 @@
 #include <epicsExport.h>
 #include <epicsTime.h>
+#include <epicsString.h>
 #include <iocsh.h>
 #include <algorithm>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include "include/LinkamSDK.h"
@@ -9,19 +11,343 @@
 #include "linkamT96.h"
 #include "epicsThread.h"
 
-CommsHandle handle = 0;
-
 static const char *driverName = "linkamT96Driver";
 
+// Longest time the acquisition thread waits for the SDK before doing a full poll (s)
+#define LINKAM_KEEPALIVE_PERIOD 1.0
+// Option card slots probed for capability discovery
+#define LINKAM_OPTION_SLOTS 4
+// Window over which the SDK update rate is measured (s)
+#define LINKAM_RATE_PERIOD 1.0
+// Default period (s) at which values held back by a deadband are published anyway
+#define LINKAM_DEADBAND_REFRESH 10.0
+// Default temperature history: keep every 10th fast sample, 3600 samples deep
+#define LINKAM_HISTORY_DEPTH 3600
+#define LINKAM_HISTORY_DECIMATION 10
+// Default number of samples kept by the stress-strain capture
+#define LINKAM_CAPTURE_DEPTH 10000
+// Wait between attempts to reach a lost controller (s): the first, doubling up to the last
+#define LINKAM_RECONNECT_MIN 2.0
+#define LINKAM_RECONNECT_MAX 60.0
+// Serial line default: 115200 8N1
+#define LINKAM_BAUD_RATE 115200
+
+static std::vector<linkamPortDriver *> drivers;
+// Handles the SDK reported connected before the open request that was given them returned
+static std::vector<CommsHandle> earlyConnects;
+// Guards drivers and earlyConnects against the SDK callbacks
+static epicsMutexId driversMutex;
+
+/*
+ * Pack the controller status flags published on LINKAM_STATUS
+ */
+static int encodeStatus(const LinkamSDK::ControllerStatus &status)
+{
+	return status.flags.controllerError               << 0  |
+	       status.flags.heater1RampSetPoint           << 1  |
+	       status.flags.heater1Started                << 2  |
+	     /*status.flags.heater2RampSetPoint           << 3  |
+	       status.flags.heater2Started                << 4  |
+	       status.flags.vacuumRampSetPoint            << 5  |
+	       status.flags.vacuumCtrlStarted             << 6  |
+	       status.flags.vacuumValveClosed             << 7  |
+	       status.flags.vacuumValveOpen               << 8  |
+	       status.flags.humidityRampSetPoint          << 3  |
+	       status.flags.humidityCtrlStarted           << 4  |*/
+	       status.flags.lnpCoolingPumpOn              << 3  |
+	       status.flags.lnpCoolingPumpAuto            << 4  |
+	     /*status.flags.HumidityDesiccantConditioning << 13 |
+	       status.flags.motorTravelMinX               << 14 |
+	       status.flags.motorTravelMaxX               << 15 |
+	       status.flags.motorStoppedX                 << 16 |
+	       status.flags.motorTravelMinY               << 17 |
+	       status.flags.motorTravelMaxY               << 18 |
+	       status.flags.motorStoppedY                 << 19 |
+	       status.flags.motorTravelMinZ               << 20 |
+	       status.flags.motorTravelMaxZ               << 21 |
+	       status.flags.motorStoppedZ                 << 22 |*/
+	       status.flags.sampleCal                     << 5;
+	     /*status.flags.motorDistanceCalTST           << 24 |
+	       status.flags.cssRotMotorStopped            << 8  |
+	       status.flags.cssGapMotorStopped            << 9  |
+	       status.flags.cssLidOn                      << 10 |
+	       status.flags.cssRefLimit                   << 11 |
+	       status.flags.cssZeroLimit                  << 12;*/
+}
+
+/*
+ * Pack the controller and stage configuration flags published on LINKAM_CONFIG and LINKAM_STAGE_CONFIG
+ */
+static int encodeControllerConfig(const LinkamSDK::ControllerConfig &config)
+{
+	return
+	      /* config.flags.supportsHeater                      << 0  |
+		 config.flags.supportsDualHeater                  << 1  |
+		 config.flags.supportsDualHeaterIndependentLimits << 2  |
+		 config.flags.supportsDualHeaterIndependentRates  << 3  |
+		 config.flags.vacuumOption                        << 4  |
+		 config.flags.tensileForceCardReady               << 5  |*/
+		 config.flags.dscCardReady                        << 0  |
+	       /*config.flags.xMotorCardReady                     << 7  |
+		 config.flags.yMotorCardReady                     << 8  |
+		 config.flags.zMotorCardReady                     << 9  |
+		 config.flags.motorValveCardReady                 << 7  |
+		 config.flags.tensileMotorCardReady               << 8  |
+		 config.flags.gradedMotorCardReady                << 9  |
+		 config.flags.dtcCardReady                        << 7  |
+		 config.flags.cssMotorCardReady                   << 8  |*/
+		 config.flags.lnpReady                            << 1/*|
+		 config.flags.lnpDualReady                        << 2  |
+		 config.flags.humidityReady                       << 3*/;
+}
+
+static int encodeStageConfig(const LinkamSDK::StageConfig &config)
+{
+	return config.flags.standardStage               << 0  |
+	       /*config.flags.highTempStage               << 1  |
+		 config.flags.peltierStage                << 2  |
+		 config.flags.gradedStage                 << 3  |
+		 config.flags.tensileStage                << 4  |*/
+		 config.flags.dscStage                    << 1  |
+	       /*config.flags.warmStage                   << 6  |
+		 config.flags.itoStage                    << 7  |
+		 config.flags.css450Stage                 << 8  |
+		 config.flags.correlativeStage            << 9  |*/
+		 config.flags.coolingManual               << 2  |
+		 config.flags.coolingAutomatic            << 3  |
+	       /*config.flags.coolingDual                 << 12 |
+		 config.flags.coolingDualSpeedIndependent << 13 |
+		 config.flags.heater1                     << 14 |
+		 config.flags.heater1TempCtrl             << 15 |
+		 config.flags.heater1TempCtrlProbe        << 16 |
+		 config.flags.heater2                     << 17 |
+		 config.flags.heater12IndependentLimits   << 18 |
+		 config.flags.waterCoolingSensorFitted    << 19 |
+		 config.flags.home                        << 20 |
+		 config.flags.supportsVacuum              << 21 |
+		 config.flags.motorX                      << 22 |
+		 config.flags.motorY                      << 23 |
+		 config.flags.motorZ                      << 24 |*/
+		 config.flags.supportsHumidity            << 4;
+}
+
+/*
+ * Controller status flags whose change means cached settings must be re-read
+ */
+static uint64_t heaterStatusMask()
+{
+	LinkamSDK::ControllerStatus status;
+	status.value = 0;
+	status.flags.heater1RampSetPoint = 1;
+	status.flags.heater1Started = 1;
+	return status.value;
+}
+
+static uint64_t tstStatusMask()
+{
+	LinkamSDK::ControllerStatus status;
+	status.value = 0;
+	status.flags.motorTravelMinZ = 1;
+	status.flags.motorTravelMaxZ = 1;
+	status.flags.motorStoppedZ = 1;
+	status.flags.motorDistanceCalTST = 1;
+	return status.value;
+}
+
+/*
+ * Parameters that map straight onto a stage value. Readbacks are polled by the acquisition
+ * thread in the group given, settings are written with SetValue. Settings are also re-read
+ * when a related status flag changes, and after a successful write of themselves or of a
+ * setting that shares their status flags.
+ */
+const LinkamParamInfo linkamPortDriver::paramTable[] = {
+	{ P_TempString, asynParamFloat64, &linkamPortDriver::P_Temp, LINKAM_VALUE(eStageValueTypeHeater1Temp),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_ALWAYS, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_RampRateString, asynParamFloat64, &linkamPortDriver::P_RampRate, LINKAM_VALUE(eStageValueTypeHeaterRate),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_ALWAYS, LINKAM_POLL_MEDIUM, heaterStatusMask, 0.0 },
+	{ P_SetpointString, asynParamFloat64, &linkamPortDriver::P_Setpoint, LINKAM_VALUE(eStageValueTypeHeaterSetpoint),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_ALWAYS, LINKAM_POLL_MEDIUM, heaterStatusMask, 0.0 },
+	{ P_PowerString, asynParamFloat64, &linkamPortDriver::P_Power, LINKAM_VALUE(eStageValueTypeHeater1Power),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_ALWAYS, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_LNPSpeedString, asynParamFloat64, &linkamPortDriver::P_LNPSpeed, LINKAM_VALUE(eStageValueTypeHeater1LNPSpeed),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_LNP, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_DSCString, asynParamFloat64, &linkamPortDriver::P_DSC, LINKAM_VALUE(eStageValueTypeDsc),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_DSC, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_HoldTimeLeftString, asynParamFloat64, &linkamPortDriver::P_HoldTimeLeft, LINKAM_VALUE(eStageValueTypeRampHoldRemaining),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_ALWAYS, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_VacuumChamberString, asynParamFloat64, &linkamPortDriver::P_VacuumChamber, LINKAM_VALUE(eStageValueTypeVacuum),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_VACUUM, LINKAM_POLL_MEDIUM, NULL, 0.0 },
+	{ P_VacuumData1String, asynParamFloat64, &linkamPortDriver::P_VacuumData1, LINKAM_VALUE(eStageValueTypeVacuumOptionBoardSensor1Data),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_VACUUM, LINKAM_POLL_MEDIUM, NULL, 0.0 },
+	{ P_RampRateSetString, asynParamFloat64, &linkamPortDriver::P_RampRateSet, LINKAM_VALUE(eStageValueTypeHeaterRate),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_ALWAYS, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_SetpointSetString, asynParamFloat64, &linkamPortDriver::P_SetpointSet, LINKAM_VALUE(eStageValueTypeHeaterSetpoint),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_ALWAYS, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_HoldTimeSetString, asynParamFloat64, &linkamPortDriver::P_HoldTimeSet, LINKAM_VALUE(eStageValueTypeRampHoldTime),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_ALWAYS, LINKAM_POLL_ONCE, NULL, 0.0 },
+	// Tensile stage
+	{ P_TstMtrVelString, asynParamFloat64, &linkamPortDriver::P_TstMtrVel, LINKAM_VALUE(eStageValueTypeTstMotorVel),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_MEDIUM, tstStatusMask, 0.0 },
+	{ P_TstMotorPosString, asynParamFloat64, &linkamPortDriver::P_TstMotorPos, LINKAM_VALUE(eStageValueTypeTstMotorPos),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_ForceString, asynParamFloat64, &linkamPortDriver::P_Force, LINKAM_VALUE(eStageValueTypeTstForce),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_ForceSetpointString, asynParamFloat64, &linkamPortDriver::P_ForceSetpoint, LINKAM_VALUE(eStageValueTypeTstForceSetpoint),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_MEDIUM, tstStatusMask, 0.0 },
+	{ P_TstMaxJawPosString, asynParamFloat64, &linkamPortDriver::P_TstMaxJawPos, LINKAM_VALUE(eStageValueTypeTstMaxExtentPosition),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstMinJawPosString, asynParamFloat64, &linkamPortDriver::P_TstMinJawPos, LINKAM_VALUE(eStageValueTypeTstMinExtentPosition),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_ForceGaugeString, asynParamFloat64, &linkamPortDriver::P_ForceGauge, LINKAM_VALUE(eStageValueTypeTstForceGauge),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_JawToJawSizeString, asynParamFloat64, &linkamPortDriver::P_JawToJawSize, LINKAM_VALUE(eStageValueTypeTstJawToJawSize),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_JawPositionString, asynParamFloat64, &linkamPortDriver::P_JawPosition, LINKAM_VALUE(eStageValueTypeTstJawPosition),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_StrainString, asynParamFloat64, &linkamPortDriver::P_Strain, LINKAM_VALUE(eStageValueTypeTstStrain),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_StressString, asynParamFloat64, &linkamPortDriver::P_Stress, LINKAM_VALUE(eStageValueTypeTstStress),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_TstDefaultMtrSpeedString, asynParamFloat64, &linkamPortDriver::P_TstDefaultMtrSpeed, LINKAM_VALUE(eStageValueTypeMotorTstDefaultSpeed),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstRawMotorPosString, asynParamFloat64, &linkamPortDriver::P_TstRawMotorPos, LINKAM_VALUE(eStageValueTypeTstRawMotorPos),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_TstMtrDistSPString, asynParamFloat64, &linkamPortDriver::P_TstMtrDistSP, LINKAM_VALUE(eStageValueTypeTstMotorDistanceSetpoint),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_MEDIUM, tstStatusMask, 0.0 },
+	{ P_TstTableDirString, asynParamInt32, &linkamPortDriver::P_TstTableDir, LINKAM_VALUE(eStageValueTypeTstTableDirection),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_MEDIUM, tstStatusMask, 0.0 },
+	{ P_StrainEguString, asynParamInt32, &linkamPortDriver::P_StrainEgu, LINKAM_VALUE(eStageValueTypeTstStrainEngineeringUnits),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstTableModeString, asynParamInt32, &linkamPortDriver::P_TstTableMode, LINKAM_VALUE(eStageValueTypeTstTableMode),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_MEDIUM, tstStatusMask, 0.0 },
+	{ P_StrainPercentageString, asynParamInt32, &linkamPortDriver::P_StrainPercentage, LINKAM_VALUE(eStageValueTypeTstStrainPercentage),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_ShowForceAsDistString, asynParamInt32, &linkamPortDriver::P_ShowForceAsDist, LINKAM_VALUE(eStageValueTypeTstShowAsForceDistance),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstJawMonitorString, asynParamInt32, &linkamPortDriver::P_TstJawMonitor, LINKAM_VALUE(eStageValueTypeTstIsJawMonitorEnabled),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstCycleCountLimString, asynParamInt32, &linkamPortDriver::P_TstCycleCountLim, LINKAM_VALUE(eStageValueTypeTstCycleCountLimit),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstCyclesRemainingString, asynParamInt32, &linkamPortDriver::P_TstCyclesRemaining, LINKAM_VALUE(eStageValueTypeTstCyclesRemaining),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_TstStatusString, asynParamInt32, &linkamPortDriver::P_TstStatus, LINKAM_VALUE(eStageValueTypeTstStatus),
+	  LINKAM_ACCESS_READ, LINKAM_CAP_TENSILE, LINKAM_POLL_FAST, NULL, 0.0 },
+	{ P_TstForceKpString, asynParamFloat64, &linkamPortDriver::P_TstForceKp, LINKAM_VALUE(eStageValueTypeTstPidKp),
+	  LINKAM_ACCESS_READ | LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstForceKiString, asynParamFloat64, &linkamPortDriver::P_TstForceKi, LINKAM_VALUE(eStageValueTypeTstPidKi),
+	  LINKAM_ACCESS_READ | LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstForceKdString, asynParamFloat64, &linkamPortDriver::P_TstForceKd, LINKAM_VALUE(eStageValueTypeTstPidKd),
+	  LINKAM_ACCESS_READ | LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_SLOW, NULL, 0.0 },
+	{ P_TstMtrVelSetString, asynParamFloat64, &linkamPortDriver::P_TstMtrVelSet, LINKAM_VALUE(eStageValueTypeTstMotorVel),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_JawToJawSizeSetString, asynParamFloat64, &linkamPortDriver::P_JawToJawSizeSet, LINKAM_VALUE(eStageValueTypeTstJawToJawSize),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_TstMaxJawPosSetString, asynParamFloat64, &linkamPortDriver::P_TstMaxJawPosSet, LINKAM_VALUE(eStageValueTypeTstMaxExtentPosition),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_TstMinJawPosSetString, asynParamFloat64, &linkamPortDriver::P_TstMinJawPosSet, LINKAM_VALUE(eStageValueTypeTstMinExtentPosition),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_TstDefaultMtrSpeedSetString, asynParamFloat64, &linkamPortDriver::P_TstDefaultMtrSpeedSet, LINKAM_VALUE(eStageValueTypeMotorTstDefaultSpeed),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_ForceSetpointSetString, asynParamFloat64, &linkamPortDriver::P_ForceSetpointSet, LINKAM_VALUE(eStageValueTypeTstForceSetpoint),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_TstMtrDistSPSetString, asynParamFloat64, &linkamPortDriver::P_TstMtrDistSPSet, LINKAM_VALUE(eStageValueTypeTstMotorDistanceSetpoint),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_ShowForceAsDistSetString, asynParamInt32, &linkamPortDriver::P_ShowForceAsDistSet, LINKAM_VALUE(eStageValueTypeTstShowAsForceDistance),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_TstTableDirSetString, asynParamInt32, &linkamPortDriver::P_TstTableDirSet, LINKAM_VALUE(eStageValueTypeTstTableDirection),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_StrainPercentageSetString, asynParamInt32, &linkamPortDriver::P_StrainPercentageSet, LINKAM_VALUE(eStageValueTypeTstStrainPercentage),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ P_StrainEguSetString, asynParamInt32, &linkamPortDriver::P_StrainEguSet, LINKAM_VALUE(eStageValueTypeTstStrainEngineeringUnits),
+	  LINKAM_ACCESS_WRITE, LINKAM_CAP_TENSILE, LINKAM_POLL_ONCE, NULL, 0.0 },
+	{ NULL }
+};
+
+/*
+ * Whether a fresh float readback has moved outside its deadband, or is due a forced refresh
+ */
+static bool publishDue(const LinkamReadback &readback, const epicsTimeStamp *now)
+{
+	return !readback.publishValid ||
+	       fabs(linkamVariantValue(readback.value, readback.valueKind) - readback.published) >= readback.deadband ||
+	       epicsTimeDiffInSeconds(now, &readback.publishedTime) >= readback.refreshPeriod;
+}
+
+static void newValueCallback(CommsHandle hDevice, LinkamSDK::ControllerStatus status)
+{
+	size_t i;
+
+	// One callback serves every controller, hand the values to the port that owns the handle
+	epicsMutexLock(driversMutex);
+	for (i = 0; i < drivers.size() && !drivers[i]->newValue(hDevice, status); i++)
+		;
+	epicsMutexUnlock(driversMutex);
+}
+
+//
+// \brief     SDK connected event. Goes to the port whose open request was given this handle.
+//            One raised before the request has returned is kept for that port to claim.
+//
+static void connectedCallback(CommsHandle hDevice)
+{
+	size_t i;
+
+	epicsMutexLock(driversMutex);
+	for (i = 0; i < drivers.size() && !drivers[i]->controllerConnected(hDevice); i++)
+		;
+	if (i == drivers.size() && hDevice != 0)
+		earlyConnects.push_back(hDevice);
+	epicsMutexUnlock(driversMutex);
+}
+
+//
+// \brief     SDK disconnected event, raised once the SDK has dropped the handle.
+//
+static void disconnectedCallback(CommsHandle hDevice)
+{
+	size_t i;
+
+	epicsMutexLock(driversMutex);
+	for (i = 0; i < drivers.size() && !drivers[i]->controllerDisconnected(hDevice); i++)
+		;
+	earlyConnects.erase(std::remove(earlyConnects.begin(), earlyConnects.end(), hDevice), earlyConnects.end());
+	epicsMutexUnlock(driversMutex);
+}
+
+//
+// \brief     Add a port to those the SDK callbacks are dispatched to.
+//
+static void addDriver(linkamPortDriver *driver)
+{
+	epicsMutexLock(driversMutex);
+	drivers.push_back(driver);
+	epicsMutexUnlock(driversMutex);
+}
+
+static void replayCallback(void *pvt, uint64_t value)
+{
+	LinkamSDK::ControllerStatus status;
+
+	status.value = value;
+	((linkamPortDriver *)pvt)->newValue(status);
+}
+
+static void acquisitionTaskC(void *drvPvt)
+{
+	linkamPortDriver *pPvt = (linkamPortDriver *)drvPvt;
+	pPvt->acquisitionTask();
+}
+
 /*
  *
  */
-linkamPortDriver::linkamPortDriver(const char *portName)
+linkamPortDriver::linkamPortDriver(const char *portName, int pollPeriodMs, int dataRateMs,
+                                   const LinkamSDK::CommsInfo *commsInfo, const char *replayFile, double replaySpeed)
 	: asynPortDriver(portName,
 			 1, /* maxAddr */
-			 asynFloat64Mask | asynInt32Mask | asynOctetMask | asynDrvUserMask, /* Interface mask */
-			 asynFloat64Mask | asynInt32Mask | asynOctetMask, /* Interrupt mask */
-			 0, /* asynFlags */
+			 asynFloat64Mask | asynInt32Mask | asynOctetMask | asynFloat64ArrayMask | asynDrvUserMask, /* Interface mask */
+			 asynFloat64Mask | asynInt32Mask | asynOctetMask | asynFloat64ArrayMask, /* Interrupt mask */
+			 ASYN_CANBLOCK, /* asynFlags: SDK calls run in the port thread, not in scan threads */
 			 1, /* Autoconnect */
 			 0, /* Default priority */
 			 0) /* Default stack size */
@@ -38,17 +364,17 @@ linkamPortDriver::linkamPortDriver(const char *portName)
 
 	(void) LinkamSDK::ControllerErrorStrings;
 
-	createParam(P_TempString,        asynParamFloat64, &P_Temp);
-	createParam(P_RampRateSetString, asynParamFloat64, &P_RampRateSet);
-	createParam(P_RampRateString,    asynParamFloat64, &P_RampRate);
-	createParam(P_SetpointSetString, asynParamFloat64, &P_SetpointSet);
-	createParam(P_SetpointString,    asynParamFloat64, &P_Setpoint);
-	createParam(P_PowerString,       asynParamFloat64, &P_Power);
+	// Stage value parameters and their readbacks come from the parameter table
+	for (const LinkamParamInfo *info = paramTable; info->name; info++) {
+		createParam(info->name, info->type, &(this->*info->param));
+		if ((size_t)(this->*info->param) >= paramInfo.size())
+			paramInfo.resize(this->*info->param + 1, NULL);
+		paramInfo[this->*info->param] = info;
+		if (info->access & LINKAM_ACCESS_READ)
+			addReadback(*info);
+	}
+
 	createParam(P_StartHeatingString,asynParamInt32,   &P_StartHeating);
-	createParam(P_LNPSpeedString,    asynParamFloat64, &P_LNPSpeed);
-	createParam(P_DSCString,         asynParamFloat64, &P_DSC);
-	createParam(P_HoldTimeSetString, asynParamInt32,   &P_HoldTimeSet);
-	createParam(P_HoldTimeLeftString,asynParamInt32,   &P_HoldTimeLeft);
 	createParam(P_LNPSetSpeedString, asynParamInt32,   &P_LNPSetSpeed);
 	createParam(P_LNPSetModeString,  asynParamInt32,   &P_LNPSetMode);
 	createParam(P_NameString,        asynParamOctet,   &P_Name);
@@ -61,78 +387,1529 @@ linkamPortDriver::linkamPortDriver(const char *portName)
 	createParam(P_CtrlConfigString,  asynParamInt32,   &P_CtrlConfig);
 	createParam(P_CtrlStatusString,  asynParamInt32,   &P_CtrlStatus);
 	createParam(P_StageConfigString, asynParamInt32,   &P_StageConfig);
-	createParam(P_VacuumChamberString, asynParamFloat64, &P_VacuumChamber);
-	createParam(P_VacuumData1String, asynParamFloat64, &P_VacuumData1);
+	createParam(P_DataRateSetString, asynParamInt32,   &P_DataRateSet);
+	createParam(P_DataRateString,    asynParamInt32,   &P_DataRate);
+	createParam(P_RxTimeoutSetString, asynParamInt32,  &P_RxTimeoutSet);
+	createParam(P_UpdateRateString,  asynParamFloat64, &P_UpdateRate);
+	createParam(P_TimeStampOffsetString, asynParamFloat64, &P_TimeStampOffset);
+	createParam(P_HistTimeString,    asynParamFloat64Array, &P_HistTime);
+	createParam(P_HistTempString,    asynParamFloat64Array, &P_HistTemp);
+	createParam(P_HistSetpointString, asynParamFloat64Array, &P_HistSetpoint);
+	createParam(P_HistPowerString,   asynParamFloat64Array, &P_HistPower);
+	createParam(P_HistLNPSpeedString, asynParamFloat64Array, &P_HistLNPSpeed);
+	createParam(P_HistCountString,   asynParamInt32,   &P_HistCount);
+	createParam(P_HistDecimationString, asynParamInt32, &P_HistDecimation);
+	createParam(P_HistResetString,   asynParamInt32,   &P_HistReset);
+	createParam(P_RecFilenameString, asynParamOctet,   &P_RecFilename);
+	createParam(P_RecStartString,    asynParamInt32,   &P_RecStart);
+	createParam(P_RecStopString,     asynParamInt32,   &P_RecStop);
+	createParam(P_RecRecordingString, asynParamInt32,  &P_RecRecording);
+	createParam(P_RecCountString,    asynParamInt32,   &P_RecCount);
+	createParam(P_RecDroppedString,  asynParamInt32,   &P_RecDropped);
+	createParam(P_RecCurrentFileString, asynParamOctet, &P_RecCurrentFile);
+	createParam(P_StatsMsgString,    asynParamFloat64Array, &P_StatsMsg);
+	createParam(P_StatsValueTypeString, asynParamFloat64Array, &P_StatsValueType);
+	createParam(P_StatsCallsString,  asynParamFloat64Array, &P_StatsCalls);
+	createParam(P_StatsFailuresString, asynParamFloat64Array, &P_StatsFailures);
+	createParam(P_StatsP50String,    asynParamFloat64Array, &P_StatsP50);
+	createParam(P_StatsP95String,    asynParamFloat64Array, &P_StatsP95);
+	createParam(P_StatsP99String,    asynParamFloat64Array, &P_StatsP99);
+	createParam(P_StatsMaxString,    asynParamFloat64Array, &P_StatsMax);
+	createParam(P_StatsResetString,  asynParamInt32,   &P_StatsReset);
 
 	// Tensile stage parameters
-    createParam(P_TstMotorPosString, asynParamFloat64, &P_TstMotorPos);
-    createParam(P_ForceString, asynParamFloat64, &P_Force);
     createParam(P_MaxForceString, asynParamFloat64, &P_MaxForce);
-    createParam(P_TstMtrVelSetString, asynParamFloat64, &P_TstMtrVelSet);
-    createParam(P_TstMtrVelString, asynParamFloat64, &P_TstMtrVel);
-    createParam(P_TstMtrDistSPSetString, asynParamFloat64, &P_TstMtrDistSPSet);
-    createParam(P_TstMtrDistSPString, asynParamFloat64, &P_TstMtrDistSP);
-    createParam(P_ForceSetpointSetString, asynParamFloat64, &P_ForceSetpointSet);
-    createParam(P_ForceSetpointString, asynParamFloat64, &P_ForceSetpoint);
-    createParam(P_ForceGaugeString, asynParamFloat64, &P_ForceGauge);
-    createParam(P_JawToJawSizeSetString, asynParamFloat64, &P_JawToJawSizeSet);
-    createParam(P_JawToJawSizeString, asynParamFloat64, &P_JawToJawSize);
-    createParam(P_TstTableDirSetString, asynParamInt32, &P_TstTableDirSet);
-    createParam(P_TstTableDirString, asynParamInt32, &P_TstTableDir);
     createParam(P_SampleWidthSetString, asynParamFloat64, &P_SampleWidthSet);
     createParam(P_SampleWidthString, asynParamFloat64, &P_SampleWidth);
     createParam(P_SampleThicknessSetString, asynParamFloat64, &P_SampleThicknessSet);
     createParam(P_SampleThicknessString, asynParamFloat64, &P_SampleThickness);
     createParam(P_SampleSizeSetString, asynParamInt32, &P_SampleSizeSet);
-    createParam(P_SampleSizeString, asynParamInt32, &P_SampleSize);
-    createParam(P_StrainEguSetString, asynParamInt32, &P_StrainEguSet);
-    createParam(P_StrainEguString, asynParamInt32, &P_StrainEgu);
-    createParam(P_StrainPercentageSetString, asynParamInt32, &P_StrainPercentageSet);
-    createParam(P_StrainPercentageString, asynParamInt32, &P_StrainPercentage);
-    createParam(P_ShowForceAsDistSetString, asynParamInt32, &P_ShowForceAsDistSet);
-    createParam(P_ShowForceAsDistString, asynParamInt32, &P_ShowForceAsDist);
     createParam(P_CalForceValSetString, asynParamFloat64, &P_CalForceValSet);
-    createParam(P_JawPositionString, asynParamFloat64, &P_JawPosition);
-    createParam(P_StrainString, asynParamFloat64, &P_Strain);
-    createParam(P_StressString, asynParamFloat64, &P_Stress);
+    createParam(P_TstSnapshotSeqString, asynParamInt32, &P_TstSnapshotSeq);
+    createParam(P_TstCapTimeString, asynParamFloat64Array, &P_TstCapTime);
+    createParam(P_TstCapStrainString, asynParamFloat64Array, &P_TstCapStrain);
+    createParam(P_TstCapStressString, asynParamFloat64Array, &P_TstCapStress);
+    createParam(P_TstCapForceString, asynParamFloat64Array, &P_TstCapForce);
+    createParam(P_TstCapPositionString, asynParamFloat64Array, &P_TstCapPosition);
+    createParam(P_TstCapCountString, asynParamInt32, &P_TstCapCount);
+    createParam(P_TstCapDoneString, asynParamInt32, &P_TstCapDone);
     createParam(P_TstTableModeSetString, asynParamInt32, &P_TstTableModeSet);
-    createParam(P_TstTableModeString, asynParamInt32, &P_TstTableMode);
-    createParam(P_TstDefaultMtrSpeedSetString, asynParamFloat64, &P_TstDefaultMtrSpeedSet);
-    createParam(P_TstDefaultMtrSpeedString, asynParamFloat64, &P_TstDefaultMtrSpeed);
     createParam(P_TstGaugeCompliancySetString, asynParamInt32, &P_TstGaugeCompliancySet);
-    createParam(P_TstMaxJawPosSetString, asynParamFloat64, &P_TstMaxJawPosSet);
-    createParam(P_TstMaxJawPosString, asynParamFloat64, &P_TstMaxJawPos);
-    createParam(P_TstMinJawPosSetString, asynParamFloat64, &P_TstMinJawPosSet);
-    createParam(P_TstMinJawPosString, asynParamFloat64, &P_TstMinJawPos);
-    createParam(P_TstRawMotorPosString, asynParamFloat64, &P_TstRawMotorPos);
     createParam(P_TstJawMonitorSetString, asynParamInt32, &P_TstJawMonitorSet);
-    createParam(P_TstJawMonitorString, asynParamInt32, &P_TstJawMonitor);
     createParam(P_TstCycleCountLimSetString, asynParamInt32, &P_TstCycleCountLimSet);
-    createParam(P_TstCycleCountLimString, asynParamInt32, &P_TstCycleCountLim);
-    createParam(P_TstCyclesRemainingString, asynParamInt32, &P_TstCyclesRemaining);
-    createParam(P_TstStatusString, asynParamInt32, &P_TstStatus);
     createParam(P_TstCalibDistanceString, asynParamInt32, &P_TstCalibDistance);
     createParam(P_TstZeroDistanceString, asynParamInt32, &P_TstZeroDistance);
     createParam(P_TstZeroForceString, asynParamInt32, &P_TstZeroForce);
     createParam(P_TstStartMotorString, asynParamInt32, &P_TstStartMotor);
 
-    createParam(P_TstForceKpString, asynParamFloat64, &P_TstForceKp);
-    createParam(P_TstForceKiString, asynParamFloat64, &P_TstForceKi);
-    createParam(P_TstForceKdString, asynParamFloat64, &P_TstForceKd);
 
-    createParam(P_TstpVeloString, asynParamFloat64, &P_TstpVelo);
-    createParam(P_TstpValString, asynParamFloat64, &P_TstpVal);
+    createParam(P_TstpVeloString, asynParamFloat64, &P_TstpVelo);
+    createParam(P_TstpValString, asynParamFloat64, &P_TstpVal);
+
+	
+    createParam(P_TstfValString, asynParamFloat64, &P_TstfVal);
+
+	// Applied by the acquisition thread when it connects, 0 leaves the SDK default
+	setIntegerParam(P_DataRateSet, dataRateMs > 0 ? dataRateMs : 0);
+	// 0 keeps the message timeout the connection was opened with
+	setIntegerParam(P_RxTimeoutSet, 0);
+	setDoubleParam(P_UpdateRate, 0.0);
+	setDoubleParam(P_TimeStampOffset, 0.0);
+
+	// Tensile values that are read back-to-back and published together as one sample
+	const int snapshotParams[] = { P_Force, P_JawPosition, P_Strain, P_Stress, P_TstRawMotorPos };
+	for (size_t i = 0; i < readbacks.size(); i++) {
+		for (size_t j = 0; j < sizeof(snapshotParams) / sizeof(snapshotParams[0]); j++) {
+			if (readbacks[i].param == snapshotParams[j])
+				readbacks[i].snapshot = true;
+		}
+	}
+	snapshotSeq = 0;
+	setIntegerParam(P_TstSnapshotSeq, snapshotSeq);
+
+	historyParams[LINKAM_HIST_TIME] = P_HistTime;
+	historyParams[LINKAM_HIST_TEMP] = P_HistTemp;
+	historyParams[LINKAM_HIST_SETPOINT] = P_HistSetpoint;
+	historyParams[LINKAM_HIST_POWER] = P_HistPower;
+	historyParams[LINKAM_HIST_LNP_SPEED] = P_HistLNPSpeed;
+	historyDepth = 0;
+	setHistory(LINKAM_HISTORY_DEPTH, LINKAM_HISTORY_DECIMATION);
+
+	captureParams[LINKAM_CAPTURE_TIME] = P_TstCapTime;
+	captureParams[LINKAM_CAPTURE_STRAIN] = P_TstCapStrain;
+	captureParams[LINKAM_CAPTURE_STRESS] = P_TstCapStress;
+	captureParams[LINKAM_CAPTURE_FORCE] = P_TstCapForce;
+	captureParams[LINKAM_CAPTURE_POSITION] = P_TstCapPosition;
+	for (int trace = 0; trace < LINKAM_NUM_CAPTURE; trace++)
+		captureReadbacks[trace] = -1;
+	for (size_t i = 0; i < readbacks.size(); i++) {
+		if (readbacks[i].param == P_Strain)
+			captureReadbacks[LINKAM_CAPTURE_STRAIN] = i;
+		else if (readbacks[i].param == P_Stress)
+			captureReadbacks[LINKAM_CAPTURE_STRESS] = i;
+		else if (readbacks[i].param == P_Force)
+			captureReadbacks[LINKAM_CAPTURE_FORCE] = i;
+		else if (readbacks[i].param == P_JawPosition)
+			captureReadbacks[LINKAM_CAPTURE_POSITION] = i;
+	}
+	capturing = false;
+	captureDepth = 0;
+	setIntegerParam(P_TstCapDone, 0);
+	setCaptureDepth(LINKAM_CAPTURE_DEPTH);
+
+	// The recorder writes one channel per readback, named after its parameter
+	std::vector<std::string> channels;
+	const char *paramName;
+	for (size_t i = 0; i < readbacks.size(); i++) {
+		getParamName(readbacks[i].param, &paramName);
+		channels.push_back(paramName);
+	}
+	recorder = new linkamRecorder(portName, channels);
+	replay = NULL;
+	if (replayFile && replayFile[0]) {
+		// A replay that finds no samples still stands in for the controller, leaving every readback invalid
+		replay = new linkamReplay(replayFile, replaySpeed, channels);
+		replay->open();
+	}
+	recordValues.assign(readbacks.size(), 0.0);
+	recordStatus = 0;
+	setStringParam(P_RecFilename, "");
+	setStringParam(P_RecCurrentFile, "");
+	publishRecorder();
+
+	statsParams[LINKAM_STATS_MSG] = P_StatsMsg;
+	statsParams[LINKAM_STATS_VALUE_TYPE] = P_StatsValueType;
+	statsParams[LINKAM_STATS_CALLS] = P_StatsCalls;
+	statsParams[LINKAM_STATS_FAILURES] = P_StatsFailures;
+	statsParams[LINKAM_STATS_P50] = P_StatsP50;
+	statsParams[LINKAM_STATS_P95] = P_StatsP95;
+	statsParams[LINKAM_STATS_P99] = P_StatsP99;
+	statsParams[LINKAM_STATS_MAX] = P_StatsMax;
+
+	lastStatus.value = 0;
+	statusChanged = 0;
+	statusPending = false;
+	newValueCount = 0;
+	epicsTimeGetCurrent(&rateStart);
+	refreshPending = true;
+	identityPending = true;
+	capabilities = LINKAM_CAP_ALL;
+	errorState = -1;
+	newValueEvent = epicsEventMustCreate(epicsEventEmpty);
+	statusMutex = epicsMutexMustCreate();
+
+	// linkamConnect opens the connection once the port can be found by the SDK callbacks,
+	// until then it counts as pending so the acquisition thread does not try first
+	handle = 0;
+	commsOpen = false;
+	sdkHandle = 0;
+	openPending = commsInfo && !replay;
+	connectPending = false;
+	connectedHandle = 0;
+	disconnectPending = false;
+	reconnectDelay = LINKAM_RECONNECT_MIN;
+	epicsTimeGetCurrent(&reconnectTime);
+	restorePending = false;
+	memset(&this->commsInfo, 0, sizeof(this->commsInfo));
+	if (commsInfo && !replay)
+		this->commsInfo = *commsInfo;
+
+	if (pollPeriodMs <= 0)
+		pollPeriodMs = 100;
+	groupPeriod[LINKAM_POLL_FAST] = pollPeriodMs / 1000.0;
+	groupPeriod[LINKAM_POLL_MEDIUM] = 1.0;
+	groupPeriod[LINKAM_POLL_SLOW] = 5.0;
+	groupPeriod[LINKAM_POLL_ONCE] = 0.0;
+	for (int group = 0; group < LINKAM_NUM_POLL_GROUPS; group++)
+		epicsTimeGetCurrent(&groupLastPoll[group]);
+
+	if (epicsThreadCreate("linkamAcquisition",
+	                      epicsThreadPriorityMedium,
+	                      epicsThreadGetStackSize(epicsThreadStackMedium),
+	                      (EPICSTHREADFUNC)acquisitionTaskC,
+	                      this) == NULL) {
+		printf("%s: epicsThreadCreate failure for acquisition task\n", driverName);
+	}
+	if (replay)
+		replay->start(replayCallback, this);
+}
+
+void linkamPortDriver::addReadback(const LinkamParamInfo &info)
+{
+	LinkamReadback readback;
+
+	readback.param = this->*info.param;
+	readback.paramType = info.type;
+	readback.valueType = info.valueType;
+	readback.valueKind = info.valueKind;
+	readback.group = info.group;
+	readback.capability = info.capability;
+	readback.statusMask = info.statusMask ? info.statusMask() : 0;
+	readback.valid = false;
+	readback.refreshed = false;
+	readback.writeRefresh = false;
+	readback.deadband = info.deadband;
+	readback.refreshPeriod = LINKAM_DEADBAND_REFRESH;
+	readback.published = 0.0;
+	readback.publishValid = false;
+	readback.snapshot = false;
+	readbacks.push_back(readback);
+}
+
+//
+// \brief     Called from the SDK data thread whenever the controller reports new values.
+//            Only records what changed; the acquisition thread does the reading.
+//
+void linkamPortDriver::newValue(LinkamSDK::ControllerStatus status)
+{
+	epicsMutexLock(statusMutex);
+	noteStatus(status);
+	epicsMutexUnlock(statusMutex);
+
+	epicsEventSignal(newValueEvent);
+}
+
+//
+// \brief     SDK new-value callback, taken if the values are from this port's controller.
+// \return    true if the handle is this port's.
+//
+bool linkamPortDriver::newValue(CommsHandle hDevice, LinkamSDK::ControllerStatus status)
+{
+	bool claimed;
+
+	epicsMutexLock(statusMutex);
+	claimed = !replay && hDevice != 0 && sdkHandle == hDevice;
+	if (claimed)
+		noteStatus(status);
+	epicsMutexUnlock(statusMutex);
+
+	if (claimed)
+		epicsEventSignal(newValueEvent);
+	return claimed;
+}
+
+//
+// \brief     Record a status report for the acquisition thread. Called with statusMutex held.
+//
+void linkamPortDriver::noteStatus(LinkamSDK::ControllerStatus status)
+{
+	statusChanged |= status.value ^ lastStatus.value;
+	lastStatus = status;
+	epicsTimeGetCurrent(&lastStatusTime);
+	statusPending = true;
+	newValueCount++;
+}
+
+//
+// \brief     Called from the SDK thread raising the connected event, or from openComms() for
+//            one raised before the request returned. Claims the event if this port is waiting
+//            for a connection with exactly that handle; the acquisition thread finishes the job.
+// \return    true if the event was for this port.
+//
+bool linkamPortDriver::controllerConnected(CommsHandle hDevice)
+{
+	bool claimed;
+
+	epicsMutexLock(statusMutex);
+	claimed = openPending && hDevice != 0 && sdkHandle == hDevice;
+	if (claimed) {
+		openPending = false;
+		connectPending = true;
+		connectedHandle = hDevice;
+	}
+	epicsMutexUnlock(statusMutex);
+
+	if (claimed)
+		epicsEventSignal(newValueEvent);
+	return claimed;
+}
+
+//
+// \brief     Called from the SDK thread raising the disconnected event. The acquisition thread
+//            takes the port down and starts reconnecting.
+// \return    true if the event was for this port.
+//
+bool linkamPortDriver::controllerDisconnected(CommsHandle hDevice)
+{
+	bool claimed;
+
+	epicsMutexLock(statusMutex);
+	claimed = hDevice != 0 && sdkHandle == hDevice;
+	if (claimed) {
+		// Nothing more from the SDK is taken for the dropped handle
+		sdkHandle = 0;
+		disconnectPending = true;
+	}
+	epicsMutexUnlock(statusMutex);
+
+	if (claimed)
+		epicsEventSignal(newValueEvent);
+	return claimed;
+}
+
+//
+// \brief     Keep the port disconnected, and so its records INVALID, until the controller has
+//            connected. The acquisition thread connects it then.
+//
+asynStatus linkamPortDriver::connect(asynUser *pasynUser)
+{
+	if (!replay && !commsOpen) {
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+		              "%s: %s waiting for the controller", driverName, portName);
+		return asynError;
+	}
+	return asynPortDriver::connect(pasynUser);
+}
+
+//
+// \brief     Acquisition thread. The fast group is refreshed when the SDK new-value callback
+//            fires, medium and slow groups when their period has elapsed, and the settings a
+//            successful write touched straight after it. Values are published with a single callParamCallbacks() so records can
+//            use I/O Intr. The fast group falls back to polling if the SDK goes quiet.
+//            The callback only brings the status word, so every one of them costs a GetValue
+//            per fast readback whether or not the value moved.
+//
+//            Until the controller has connected nothing is read; once it has, the port is
+//            connected and everything, identity included, is read afresh. When the SDK reports
+//            the controller gone the port is disconnected again and no more calls are made on
+//            the dead handle. The SDK keeps waiting for it on a pending request; a refused one
+//            is retried with exponential backoff. Settings written before the loss are written
+//            back once the controller is reached again.
+//
+void linkamPortDriver::acquisitionTask(void)
+{
+	LinkamSDK::ControllerStatus status;
+	epicsTimeStamp statusTime, start, end;
+	uint64_t changed;
+	unsigned int groupsDue;
+	bool pending, identity, captureDue, connected, disconnected, retry, restore, written;
+	CommsHandle connectedTo;
+	size_t i;
+	unsigned int count = 0;
+	double delay, elapsed, updateRate = -1.0;
+	int group, dataRate, rxTimeout;
+
+	while (true) {
+		epicsEventWaitWithTimeout(newValueEvent, groupPeriod[LINKAM_POLL_FAST]);
+		epicsTimeGetCurrent(&start);
+
+		epicsMutexLock(statusMutex);
+		pending = statusPending;
+		changed = statusChanged;
+		status = lastStatus;
+		statusTime = lastStatusTime;
+		statusPending = false;
+		statusChanged = 0;
+		connected = connectPending;
+		connectedTo = connectedHandle;
+		connectPending = false;
+		disconnected = disconnectPending;
+		disconnectPending = false;
+		retry = !openPending;
+		elapsed = epicsTimeDiffInSeconds(&start, &rateStart);
+		if (elapsed >= LINKAM_RATE_PERIOD) {
+			count = newValueCount;
+			newValueCount = 0;
+			rateStart = start;
+			updateRate = count / elapsed;
+		}
+		epicsMutexUnlock(statusMutex);
+
+		lock();
+		if (disconnected && commsOpen) {
+			printf("%s: %s lost the controller, reconnecting\n", driverName, portName);
+			commsOpen = false;
+			handle = 0;
+			for (i = 0; i < readbacks.size(); i++) {
+				readbacks[i].publishValid = false;
+				setParamStatus(readbacks[i].param, asynDisconnected);
+			}
+			callParamCallbacks();
+			pasynManager->exceptionDisconnect(pasynUserSelf);
+			reconnectDelay = LINKAM_RECONNECT_MIN;
+			reconnectTime = start;
+			epicsTimeAddSeconds(&reconnectTime, reconnectDelay);
+			restorePending = true;
+		}
+		if (connected) {
+			handle = connectedTo;
+			commsOpen = true;
+			identityPending = true;
+			refreshPending = true;
+			reconnectDelay = LINKAM_RECONNECT_MIN;
+			printf("%s: %s connected to the controller, handle %llu\n", driverName, portName, (unsigned long long)handle);
+			pasynManager->exceptionConnect(pasynUserSelf);
+		}
+		if (updateRate >= 0) {
+			setDoubleParam(P_UpdateRate, updateRate);
+			publishRecorder();
+			publishStats();
+			callParamCallbacks();
+			updateRate = -1.0;
+		}
+		if (!replay && !commsOpen) {
+			unlock();
+			if (retry && epicsTimeDiffInSeconds(&start, &reconnectTime) >= 0) {
+				openComms();
+				reconnectTime = start;
+				epicsTimeAddSeconds(&reconnectTime, reconnectDelay);
+				reconnectDelay = std::min(reconnectDelay * 2, LINKAM_RECONNECT_MAX);
+			}
+			continue;
+		}
+		groupsDue = 0;
+		if (refreshPending)
+			groupsDue = (1 << LINKAM_NUM_POLL_GROUPS) - 1;
+		refreshPending = false;
+		if (capturing) {
+			// Capture the tensile snapshot at the SDK data rate, the rest of the fast group at its period
+			captureDue = pending;
+			if (epicsTimeDiffInSeconds(&start, &groupLastPoll[LINKAM_POLL_FAST]) >= groupPeriod[LINKAM_POLL_FAST])
+				groupsDue |= 1 << LINKAM_POLL_FAST;
+		} else {
+			captureDue = false;
+			if (pending || epicsTimeDiffInSeconds(&start, &groupLastPoll[LINKAM_POLL_FAST]) >= LINKAM_KEEPALIVE_PERIOD)
+				groupsDue |= 1 << LINKAM_POLL_FAST;
+		}
+		for (group = LINKAM_POLL_MEDIUM; group < LINKAM_POLL_ONCE; group++) {
+			if (epicsTimeDiffInSeconds(&start, &groupLastPoll[group]) >= groupPeriod[group])
+				groupsDue |= 1 << group;
+		}
+		for (written = false, i = 0; !written && i < readbacks.size(); i++)
+			written = readbacks[i].writeRefresh;
+		identity = identityPending;
+		identityPending = false;
+		restore = identity && restorePending;
+		restorePending = restorePending && !identity;
+		unlock();
+
+		if (identity) {
+			discoverCapabilities();
+			refreshIdentity();
+			if (restore)
+				restoreSettings();
+
+			lock();
+			getIntegerParam(P_DataRateSet, &dataRate);
+			setDataRate(dataRate);
+			getIntegerParam(P_RxTimeoutSet, &rxTimeout);
+			setRxTimeout(rxTimeout);
+			callParamCallbacks();
+			unlock();
+		}
+
+		if (groupsDue || changed || captureDue || written) {
+			pollReadbacks(groupsDue, changed, pending ? &status : NULL, &statusTime, captureDue);
+			for (group = 0; group < LINKAM_NUM_POLL_GROUPS; group++) {
+				if (groupsDue & (1 << group))
+					groupLastPoll[group] = start;
+			}
+		}
+
+		// Do not refresh faster than the fast group period however often the SDK calls back,
+		// unless a capture wants every SDK update
+		epicsTimeGetCurrent(&end);
+		delay = groupPeriod[LINKAM_POLL_FAST] - epicsTimeDiffInSeconds(&end, &start);
+		if (delay > 0 && !captureDue)
+			epicsThreadSleep(delay);
+	}
+}
+
+//
+// \brief     Read the readbacks in the due poll groups, plus settings whose status flags changed,
+//            and publish them. The controller status comes from the SDK callback when given,
+//            otherwise it is polled along with the fast group.
+//
+//            The values are stamped with the time they were acquired rather than when records
+//            process: the SDK callback time when the SDK reported new values (GetValue returns
+//            the values its data thread fetched then), otherwise the time the first value came
+//            back. LINKAM_TS_OFFSET (ms) is subtracted to allow for link latency. Records use
+//            the stamp with TSE = -2.
+//
+void linkamPortDriver::pollReadbacks(unsigned int groupsDue, uint64_t changed, LinkamSDK::ControllerStatus *status,
+                                     const epicsTimeStamp *statusTime, bool captureDue)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant polledStatus;
+	LinkamSDK::Variant sampleSize;
+	LinkamSDK::Variant result;
+	epicsTimeStamp now, sampleTime;
+	double offset;
+	bool sampled = false;
+	const char *errorString = NULL;
+	bool statusValid = true, sampleSizeValid = false;
+	bool errorUpdated = false, errorValid = false, stageChanged = false;
+	bool tensile, snapshotDue = false, snapshotPublish = false, tempSampled = false;
+	size_t i;
+
+	lock();
+	for (i = 0; i < readbacks.size(); i++) {
+		readbacks[i].refreshed = !(readbacks[i].capability & ~capabilities) &&
+		                         ((groupsDue & (1 << readbacks[i].group)) || (readbacks[i].statusMask & changed) ||
+		                          readbacks[i].writeRefresh);
+		readbacks[i].writeRefresh = false;
+		if (readbacks[i].snapshot && readbacks[i].refreshed)
+			snapshotDue = true;
+	}
+	if (captureDue && (capabilities & LINKAM_CAP_TENSILE))
+		snapshotDue = true;
+	// A snapshot is all or nothing, whichever poll groups its members are in
+	for (i = 0; snapshotDue && i < readbacks.size(); i++) {
+		if (readbacks[i].snapshot)
+			readbacks[i].refreshed = !(readbacks[i].capability & ~capabilities);
+	}
+	tensile = capabilities & LINKAM_CAP_TENSILE;
+
+	// Read the snapshot back-to-back with the port locked, so no write lands in the middle of it
+	for (i = 0; snapshotDue && i < readbacks.size(); i++) {
+		if (!readbacks[i].snapshot || !readbacks[i].refreshed)
+			continue;
+		param1.vStageValueType = readbacks[i].valueType;
+		readbacks[i].value.vUint64 = 0;
+		readbacks[i].valid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue,
+		                                    &readbacks[i].value, param1, param2);
+	}
+	unlock();
+
+	if (status) {
+		sampleTime = *statusTime;
+		sampled = true;
+	} else if (snapshotDue) {
+		epicsTimeGetCurrent(&sampleTime);
+		sampled = true;
+	}
+
+	// Talk to the controller without holding the port lock so writes are not held up
+	for (i = 0; i < readbacks.size(); i++) {
+		if (!readbacks[i].refreshed || readbacks[i].snapshot)
+			continue;
+		param1.vStageValueType = readbacks[i].valueType;
+		readbacks[i].value.vUint64 = 0;
+		readbacks[i].valid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue,
+		                                    &readbacks[i].value, param1, param2);
+		if (readbacks[i].valid && !sampled) {
+			epicsTimeGetCurrent(&sampleTime);
+			sampled = true;
+		}
+	}
+
+	if (status == NULL && (groupsDue & (1 << LINKAM_POLL_FAST))) {
+		statusValid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStatus, &polledStatus);
+		status = &polledStatus.vControllerStatus;
+		if (statusValid && !sampled) {
+			epicsTimeGetCurrent(&sampleTime);
+			sampled = true;
+		}
+	}
+
+	if (tensile && (groupsDue & (1 << LINKAM_POLL_SLOW))) {
+		param1.vStageValueType = LinkamSDK::eStageValueTypeTstSampleSize;
+		sampleSizeValid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, &sampleSize, param1, param2);
+	}
+
+	// The error text is only looked up when the controller error flag changes
+	if (status && statusValid && (int)status->flags.controllerError != errorState) {
+		if (status->flags.controllerError) {
+			errorValid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetControllerError, &result);
+			if (errorValid) {
+				errorString = LinkamSDK::ControllerErrorStrings[result.vControllerError];
+				printf("Controller Error %i: %s\n", result.vControllerError, errorString);
+			}
+		} else {
+			errorString = LinkamSDK::ControllerErrorStrings[0];
+			errorValid = true;
+		}
+		// An error clearing is what a stage being (re)connected looks like, so re-read its identity
+		if (errorState == 1 && !status->flags.controllerError)
+			stageChanged = true;
+		errorState = status->flags.controllerError;
+		errorUpdated = true;
+	}
+
+	lock();
+	epicsTimeGetCurrent(&now);
+	for (i = 0; snapshotDue && i < readbacks.size(); i++) {
+		if (readbacks[i].snapshot && readbacks[i].refreshed && readbacks[i].valid && publishDue(readbacks[i], &now))
+			snapshotPublish = true;
+	}
+	for (i = 0; i < readbacks.size(); i++) {
+		LinkamReadback &readback = readbacks[i];
+
+		if (!readback.refreshed)
+			continue;
+		if (!readback.valid) {
+			readback.publishValid = false;
+		} else if (readback.paramType == asynParamInt32) {
+			// The parameter library only raises callbacks for values that changed
+			setIntegerParam(readback.param, (epicsInt32)linkamVariantValue(readback.value, readback.valueKind));
+		} else if (readback.snapshot ? snapshotPublish : publishDue(readback, &now)) {
+			// Float values that wander inside the deadband are held back to save monitor traffic,
+			// snapshot members are published together when any of them moves
+			readback.published = linkamVariantValue(readback.value, readback.valueKind);
+			setDoubleParam(readback.param, readback.published);
+			readback.publishedTime = now;
+			readback.publishValid = true;
+		}
+		setParamStatus(readback.param, readback.valid ? asynSuccess : asynError);
+		if (readback.param == P_Temp && readback.valid)
+			tempSampled = true;
+	}
+	if (snapshotPublish)
+		setIntegerParam(P_TstSnapshotSeq, ++snapshotSeq);
+
+	if (status) {
+		if (statusValid) {
+			setIntegerParam(P_CtrlStatus, encodeStatus(*status));
+			recordStatus = status->value;
+		}
+		setParamStatus(P_CtrlStatus, statusValid ? asynSuccess : asynError);
+	}
+
+	if (sampleSizeValid) {
+		setDoubleParam(P_SampleWidth, sampleSize.vTSTSampleSize.width);
+		setDoubleParam(P_SampleThickness, sampleSize.vTSTSampleSize.thickness);
+	}
+
+	if (errorUpdated) {
+		if (errorValid)
+			setStringParam(P_CtrllrError, errorString);
+		setParamStatus(P_CtrllrError, errorValid ? asynSuccess : asynError);
+	}
+	if (stageChanged)
+		identityPending = true;
+
+	if (sampled) {
+		getDoubleParam(P_TimeStampOffset, &offset);
+		epicsTimeAddSeconds(&sampleTime, -offset / 1000.0);
+		setTimeStamp(&sampleTime);
+		if (recorder->recording())
+			recordSample(&sampleTime);
+	} else {
+		updateTimeStamp();
+	}
+
+	if (tempSampled) {
+		getTimeStamp(&now);
+		if (addHistorySample(&now))
+			historyUnpublished = true;
+	}
+	// Publish the whole history at the medium group rate rather than every sample
+	if (historyUnpublished && (groupsDue & (1 << LINKAM_POLL_MEDIUM)))
+		publishHistory();
+
+	if (capturing) {
+		if (snapshotDue)
+			addCaptureSample(&sampleTime);
+		// The motor stops by itself at its distance setpoint or a limit
+		if (status && statusValid) {
+			if (!status->flags.motorStoppedZ)
+				captureMotorMoved = true;
+			else if (captureMotorMoved)
+				stopCapture();
+		}
+		// Publish the curve so far at the fast group rate rather than every sample
+		if (capturing && (groupsDue & (1 << LINKAM_POLL_FAST)))
+			publishCapture();
+	}
+	callParamCallbacks();
+	unlock();
+}
+
+//
+// \brief     Add the latest temperature, setpoint, power and LNP speed to the history, keeping
+//            one fast sample in every LINKAM_HIST_DECIMATION. Called with the port locked.
+// \param[in] time          Acquisition time of the sample.
+// \return    true if a sample was stored.
+//
+bool linkamPortDriver::addHistorySample(const epicsTimeStamp *time)
+{
+	double temp, setpoint, power, lnpSpeed;
+	int decimation;
+
+	if (historyDepth == 0)
+		return false;
+	getIntegerParam(P_HistDecimation, &decimation);
+	if (++historyTick < decimation)
+		return false;
+	historyTick = 0;
+
+	getDoubleParam(P_Temp, &temp);
+	getDoubleParam(P_Setpoint, &setpoint);
+	getDoubleParam(P_Power, &power);
+	getDoubleParam(P_LNPSpeed, &lnpSpeed);
+
+	// Time axis in POSIX seconds so scripts can use it directly
+	history[LINKAM_HIST_TIME][historyHead] = time->secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH + time->nsec / 1e9;
+	history[LINKAM_HIST_TEMP][historyHead] = temp;
+	history[LINKAM_HIST_SETPOINT][historyHead] = setpoint;
+	history[LINKAM_HIST_POWER][historyHead] = power;
+	history[LINKAM_HIST_LNP_SPEED][historyHead] = lnpSpeed;
+
+	historyHead = (historyHead + 1) % historyDepth;
+	if (historyCount < historyDepth)
+		historyCount++;
+	setIntegerParam(P_HistCount, historyCount);
+	return true;
+}
+
+//
+// \brief     Copy the newest maxPoints samples of a history trace, oldest first.
+// \return    Number of samples copied.
+//
+size_t linkamPortDriver::copyHistory(int trace, epicsFloat64 *value, size_t maxPoints)
+{
+	size_t n = std::min(historyCount, maxPoints);
+	size_t start, i;
+
+	if (n == 0)
+		return 0;
+	start = (historyHead + historyDepth - n) % historyDepth;
+	for (i = 0; i < n; i++)
+		value[i] = history[trace][(start + i) % historyDepth];
+	return n;
+}
+
+void linkamPortDriver::publishHistory(void)
+{
+	size_t n;
+	int trace;
+
+	for (trace = 0; trace < LINKAM_NUM_HIST; trace++) {
+		n = copyHistory(trace, historyOut.empty() ? NULL : &historyOut[0], historyDepth);
+		doCallbacksFloat64Array(historyOut.empty() ? NULL : &historyOut[0], n, historyParams[trace], 0);
+	}
+	historyUnpublished = false;
+}
+
+void linkamPortDriver::resetHistory(void)
+{
+	historyHead = 0;
+	historyCount = 0;
+	historyTick = 0;
+	historyUnpublished = false;
+	setIntegerParam(P_HistCount, 0);
+}
+
+//
+// \brief     Start or stop the TST motor, starting a stress-strain capture with it or ending
+//            the one running. Called with the port locked.
+// \return    false if the controller did not take the command.
+//
+bool linkamPortDriver::runMotor(bool run)
+{
+	LinkamSDK::Variant result;
+	LinkamSDK::Variant axis;
+
+	// StartMotors function takes 5 as TST motor
+	axis.vInt32 = 5;
+	if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_StartMotors, &result, LinkamSDK::Variant(run), axis))
+		return false;
+	if (run)
+		startCapture();
+	else
+		stopCapture();
+	return true;
+}
+
+//
+// \brief     Start a stress-strain capture, called with the port locked when the TST motor is started.
+//
+void linkamPortDriver::startCapture(void)
+{
+	if (captureDepth == 0)
+		return;
+	captureCount = 0;
+	capturing = true;
+	captureMotorMoved = false;
+	setIntegerParam(P_TstCapCount, 0);
+	setIntegerParam(P_TstCapDone, 0);
+	publishCapture();
+}
+
+//
+// \brief     End the capture, publish the full curve and raise the done flag. Called with the port locked.
+//
+void linkamPortDriver::stopCapture(void)
+{
+	if (!capturing)
+		return;
+	capturing = false;
+	publishCapture();
+	setIntegerParam(P_TstCapDone, 1);
+}
+
+//
+// \brief     Append the latest tensile snapshot to the capture. Called with the port locked.
+// \param[in] time          Acquisition time of the snapshot.
+// \return    true if a sample was stored.
+//
+bool linkamPortDriver::addCaptureSample(const epicsTimeStamp *time)
+{
+	int trace;
+
+	for (trace = LINKAM_CAPTURE_STRAIN; trace < LINKAM_NUM_CAPTURE; trace++) {
+		if (captureReadbacks[trace] < 0 || !readbacks[captureReadbacks[trace]].valid)
+			return false;
+	}
+	if (captureCount == captureDepth) {
+		stopCapture();
+		return false;
+	}
+
+	if (captureCount == 0)
+		captureStart = *time;
+	capture[LINKAM_CAPTURE_TIME][captureCount] = epicsTimeDiffInSeconds(time, &captureStart);
+	for (trace = LINKAM_CAPTURE_STRAIN; trace < LINKAM_NUM_CAPTURE; trace++) {
+		const LinkamReadback &readback = readbacks[captureReadbacks[trace]];
+		capture[trace][captureCount] = linkamVariantValue(readback.value, readback.valueKind);
+	}
+	captureCount++;
+	setIntegerParam(P_TstCapCount, captureCount);
+	return true;
+}
+
+void linkamPortDriver::publishCapture(void)
+{
+	int trace;
+
+	for (trace = 0; trace < LINKAM_NUM_CAPTURE; trace++)
+		doCallbacksFloat64Array(capture[trace].empty() ? NULL : &capture[trace][0], captureCount, captureParams[trace], 0);
+}
+
+//
+// \brief     Queue the readbacks just read, with the controller status, for the recorder.
+//            Channels not read this time repeat their last value with their valid bit clear.
+//            Called with the port locked from the acquisition thread, never blocks.
+//
+void linkamPortDriver::recordSample(const epicsTimeStamp *time)
+{
+	uint64_t validMask = 0;
+	size_t i;
+
+	for (i = 0; i < readbacks.size() && i < LINKAM_RECORDER_MAX_CHANNELS; i++) {
+		if (!readbacks[i].refreshed || !readbacks[i].valid)
+			continue;
+		recordValues[i] = linkamVariantValue(readbacks[i].value, readbacks[i].valueKind);
+		validMask |= (uint64_t)1 << i;
+	}
+	recorder->push(time, recordStatus, validMask, &recordValues[0]);
+}
+
+//
+// \brief     Update the recorder state parameters. Called with the port locked.
+//
+void linkamPortDriver::publishRecorder(void)
+{
+	char fileName[256];
+
+	recorder->currentFile(fileName, sizeof(fileName));
+	setIntegerParam(P_RecRecording, recorder->recording());
+	setIntegerParam(P_RecCount, recorder->recorded());
+	setIntegerParam(P_RecDropped, recorder->dropped());
+	setStringParam(P_RecCurrentFile, fileName);
+}
+
+//
+// \brief     Publish the SDK call latency table. Called with the port locked.
+//
+void linkamPortDriver::publishStats(void)
+{
+	std::vector<linkamStats::Summary> summaries;
+	size_t i;
+	int column;
+
+	stats.summarise(summaries);
+	for (column = 0; column < LINKAM_NUM_STATS; column++)
+		statsOut[column].resize(summaries.size());
+	for (i = 0; i < summaries.size(); i++) {
+		statsOut[LINKAM_STATS_MSG][i] = summaries[i].msgCode;
+		statsOut[LINKAM_STATS_VALUE_TYPE][i] = summaries[i].valueType;
+		statsOut[LINKAM_STATS_CALLS][i] = summaries[i].calls;
+		statsOut[LINKAM_STATS_FAILURES][i] = summaries[i].failures;
+		statsOut[LINKAM_STATS_P50][i] = summaries[i].p50;
+		statsOut[LINKAM_STATS_P95][i] = summaries[i].p95;
+		statsOut[LINKAM_STATS_P99][i] = summaries[i].p99;
+		statsOut[LINKAM_STATS_MAX][i] = summaries[i].max;
+	}
+	for (column = 0; column < LINKAM_NUM_STATS; column++)
+		doCallbacksFloat64Array(summaries.empty() ? NULL : &statsOut[column][0], summaries.size(), statsParams[column], 0);
+}
+
+void linkamPortDriver::reportStats(FILE *fp)
+{
+	fprintf(fp, "%s: SDK call latency\n", portName);
+	stats.report(fp);
+}
+
+//
+// \brief     Set the size each recording file is pre-extended to before rolling over.
+// \param[in] fileSizeMB    File size in MB, applies from the next REC:START.
+//
+asynStatus linkamPortDriver::setRecorderFileSize(int fileSizeMB)
+{
+	if (fileSizeMB <= 0)
+		return asynError;
+
+	recorder->setFileSize((size_t)fileSizeMB * 1024 * 1024);
+	return asynSuccess;
+}
+
+//
+// \brief     Resize the stress-strain capture buffers, abandoning any capture in progress.
+// \param[in] depth         Number of samples kept per capture, 0 to turn capturing off.
+//
+asynStatus linkamPortDriver::setCaptureDepth(int depth)
+{
+	int trace;
+
+	if (depth < 0)
+		return asynError;
+
+	lock();
+	capturing = false;
+	captureDepth = depth;
+	captureCount = 0;
+	for (trace = 0; trace < LINKAM_NUM_CAPTURE; trace++)
+		capture[trace].assign(captureDepth, 0.0);
+	setIntegerParam(P_TstCapCount, 0);
+	publishCapture();
+	callParamCallbacks();
+	unlock();
+
+	return asynSuccess;
+}
+
+//
+// \brief     Resize the temperature history. The buffers are allocated here, not while acquiring.
+// \param[in] depth         Number of samples kept, 0 to turn the history off.
+// \param[in] decimation    Keep one in this many fast samples, ignored if <= 0.
+//
+asynStatus linkamPortDriver::setHistory(int depth, int decimation)
+{
+	int trace;
+
+	if (depth < 0)
+		return asynError;
+
+	lock();
+	historyDepth = depth;
+	for (trace = 0; trace < LINKAM_NUM_HIST; trace++)
+		history[trace].assign(historyDepth, 0.0);
+	historyOut.assign(historyDepth, 0.0);
+	resetHistory();
+	if (decimation > 0)
+		setIntegerParam(P_HistDecimation, decimation);
+	publishHistory();
+	callParamCallbacks();
+	unlock();
+
+	return asynSuccess;
+}
+
+//
+// \brief     Read the controller and stage identity strings into the parameter library. These
+//            do not change while a stage is connected, so they are only fetched at connect and
+//            when the stage is reconnected rather than on every record process.
+//
+void linkamPortDriver::refreshIdentity(void)
+{
+	const int params[] = { P_Name, P_Serial, P_StageName, P_StageSerial, P_FirmVer, P_HardVer };
+	const LinkamSDK::LinkamFunctionMsgCode msgCodes[] = {
+		LinkamSDK::eLinkamFunctionMsgCode_GetControllerName,
+		LinkamSDK::eLinkamFunctionMsgCode_GetControllerSerial,
+		LinkamSDK::eLinkamFunctionMsgCode_GetStageName,
+		LinkamSDK::eLinkamFunctionMsgCode_GetStageSerial,
+		LinkamSDK::eLinkamFunctionMsgCode_GetControllerFirmwareVersion,
+		LinkamSDK::eLinkamFunctionMsgCode_GetControllerHardwareVersion
+	};
+	const int numIdentity = sizeof(params) / sizeof(params[0]);
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant result;
+	char strings[numIdentity][256];
+	bool valid[numIdentity];
+	int i;
+
+	for (i = 0; i < numIdentity; i++) {
+		strings[i][0] = '\0';
+		result.vUint64 = 0;
+		param1.vPtr = strings[i];
+		param2.vUint32 = sizeof(strings[i]);
+		valid[i] = processMessage(msgCodes[i], &result, param1, param2);
+		if (valid[i])
+			rtrim(strings[i]);
+	}
+
+	lock();
+	for (i = 0; i < numIdentity; i++) {
+		if (valid[i])
+			setStringParam(params[i], strings[i]);
+		setParamStatus(params[i], valid[i] ? asynSuccess : asynError);
+	}
+	callParamCallbacks();
+	unlock();
+}
+
+//
+// \brief     Work out which optional hardware is present from the controller and stage
+//            configuration, the stage type and the fitted option cards. Readbacks needing
+//            hardware that is not there are dropped from the poll set, so they do not each
+//            cost an SDK round trip (or a timeout) every cycle.
+//
+void linkamPortDriver::discoverCapabilities(void)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant ctrlConfig;
+	LinkamSDK::Variant stageConfig;
+	LinkamSDK::Variant result;
+	bool ctrlValid, stageValid;
+	unsigned int caps = 0;
+	unsigned int slot;
+	size_t i;
+
+	ctrlValid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetControllerConfig, &ctrlConfig);
+	stageValid = processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStageConfig, &stageConfig);
+
+	if (ctrlValid) {
+		if (ctrlConfig.vControllerConfig.flags.lnpReady || ctrlConfig.vControllerConfig.flags.lnpDualReady)
+			caps |= LINKAM_CAP_LNP;
+		if (ctrlConfig.vControllerConfig.flags.dscCardReady)
+			caps |= LINKAM_CAP_DSC;
+		if (ctrlConfig.vControllerConfig.flags.vacuumOption)
+			caps |= LINKAM_CAP_VACUUM;
+		if (ctrlConfig.vControllerConfig.flags.tensileForceCardReady || ctrlConfig.vControllerConfig.flags.tensileMotorCardReady)
+			caps |= LINKAM_CAP_TENSILE;
+	} else {
+		// Without the controller configuration there is no telling what is fitted, so poll everything
+		caps = LINKAM_CAP_ALL;
+	}
+
+	if (stageValid) {
+		if (stageConfig.vStageConfig.flags.dscStage)
+			caps |= LINKAM_CAP_DSC;
+		if (stageConfig.vStageConfig.flags.tensileStage)
+			caps |= LINKAM_CAP_TENSILE;
+		if (stageConfig.vStageConfig.flags.supportsVacuum)
+			caps |= LINKAM_CAP_VACUUM;
+	}
+
+	if (processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStageType, &result)) {
+		switch (result.vStageType) {
+		case LinkamSDK::eStageType_DifferentialScanningCalorimetry:
+		case LinkamSDK::eStageType_DifferentialScanningCalorimetryV2:
+			caps |= LINKAM_CAP_DSC;
+			break;
+		case LinkamSDK::eStageType_Vacuum:
+		case LinkamSDK::eStageType_ThermocoupledVacuum:
+			caps |= LINKAM_CAP_VACUUM;
+			break;
+		case LinkamSDK::eStageType_TensileTest:
+		case LinkamSDK::eStageType_TensileTestV2:
+			caps |= LINKAM_CAP_TENSILE;
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (slot = 0; slot < LINKAM_OPTION_SLOTS; slot++) {
+		param1.vUint32 = slot;
+		if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetOptionCardType, &result, param1, param2))
+			break;
+		switch (result.vOptionBoardType) {
+		case LinkamSDK::eOptionBoardType_DSCBoard:
+			caps |= LINKAM_CAP_DSC;
+			break;
+		case LinkamSDK::eOptionBoardType_VacuumMotorBoard:
+		case LinkamSDK::eOptionBoardType_SingleVacuumBoard:
+		case LinkamSDK::eOptionBoardType_DualVacuumBoard:
+			caps |= LINKAM_CAP_VACUUM;
+			break;
+		case LinkamSDK::eOptionBoardType_TSTMotorBoard:
+		case LinkamSDK::eOptionBoardType_TSTBoard:
+			caps |= LINKAM_CAP_TENSILE;
+			break;
+		default:
+			break;
+		}
+	}
+
+	lock();
+	// Newly fitted hardware needs all of its readbacks read, not just the fast ones
+	if (caps & ~capabilities)
+		refreshPending = true;
+	capabilities = caps;
+	if (ctrlValid)
+		setIntegerParam(P_CtrlConfig, encodeControllerConfig(ctrlConfig.vControllerConfig));
+	setParamStatus(P_CtrlConfig, ctrlValid ? asynSuccess : asynError);
+	if (stageValid)
+		setIntegerParam(P_StageConfig, encodeStageConfig(stageConfig.vStageConfig));
+	setParamStatus(P_StageConfig, stageValid ? asynSuccess : asynError);
+
+	for (i = 0; i < readbacks.size(); i++) {
+		if (readbacks[i].capability & ~capabilities)
+			setParamStatus(readbacks[i].param, asynDisabled);
+	}
+	callParamCallbacks();
+	unlock();
+}
+
+//
+// \brief     Set the rate of the SDK internal data request thread and read back the rate it
+//            actually uses, since the SDK regulates it and may override the request. Called
+//            with the port locked.
+// \param[in] dataRateMs    Requested rate in ms (5-1000), 0 to leave the rate unchanged.
+//
+asynStatus linkamPortDriver::setDataRate(int dataRateMs)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant result;
+	asynStatus status = asynSuccess;
+
+	if (dataRateMs > 0) {
+		param1.vUint32 = dataRateMs;
+		if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetDataRate, &result, param1, param2))
+			status = asynError;
+	}
+
+	result.vUint64 = 0;
+	if (processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetDataRate, &result)) {
+		setIntegerParam(P_DataRate, result.vUint32);
+		setParamStatus(P_DataRate, asynSuccess);
+	} else {
+		setParamStatus(P_DataRate, asynError);
+	}
+
+	return status;
+}
+
+//
+// \brief     Write the settings last written through the port back to a controller that has
+//            been reconnected, which may have been power cycled meanwhile. Heating and motion
+//            are left for the operator to restart.
+//
+void linkamPortDriver::restoreSettings(void)
+{
+	std::vector<std::pair<const LinkamParamInfo *, double> > restore;
+	std::map<int, double>::const_iterator it;
+	const LinkamParamInfo *info;
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant result;
+	size_t i;
+
+	lock();
+	for (it = settings.begin(); it != settings.end(); ++it) {
+		info = findParamInfo(it->first);
+		if (info && !(info->capability & ~capabilities))
+			restore.push_back(std::make_pair(info, it->second));
+	}
+	refreshPending = true;
+	unlock();
+
+	for (i = 0; i < restore.size(); i++) {
+		param1.vStageValueType = restore[i].first->valueType;
+		linkamSetVariantValue(param2, restore[i].first->valueKind, restore[i].second);
+		if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, &result, param1, param2))
+			printf("%s: %s could not restore %s\n", driverName, portName, restore[i].first->name);
+	}
+	if (!restore.empty())
+		printf("%s: %s restored %d setting(s)\n", driverName, portName, (int)restore.size());
+}
+
+//
+// \brief     Change how long the SDK waits for a reply to a message before dropping it, to fail
+//            fast on a slow link instead of blocking the port. Called with the port locked.
+// \param[in] timeoutMs     Timeout in ms, 0 to leave the timeout unchanged.
+//
+asynStatus linkamPortDriver::setRxTimeout(int timeoutMs)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant result;
+
+	if (timeoutMs <= 0)
+		return asynSuccess;
+	param1.vUint64 = (uint64_t)timeoutMs * 1000;
+	if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetCommsRxTimeout, &result, param1))
+		return asynError;
+	return asynSuccess;
+}
+
+static const char *pollGroupNames[LINKAM_NUM_POLL_GROUPS] = { "fast", "medium", "slow", "once" };
+
+//
+// \brief     Move readbacks into a poll group and optionally change the group period.
+// \param[in] groupName     One of fast, medium, slow or once.
+// \param[in] periodMs      New period for the group in ms, ignored if <= 0 or for once.
+// \param[in] nParams       Number of entries in paramNames.
+// \param[in] paramNames    asyn parameter names (e.g. LINKAM_TEMP) to assign to the group.
+//
+asynStatus linkamPortDriver::setPollGroup(const char *groupName, int periodMs, int nParams, char **paramNames)
+{
+	asynStatus status = asynSuccess;
+	int group, index, i;
+
+	for (group = 0; group < LINKAM_NUM_POLL_GROUPS; group++) {
+		if (epicsStrCaseCmp(groupName, pollGroupNames[group]) == 0)
+			break;
+	}
+	if (group == LINKAM_NUM_POLL_GROUPS) {
+		printf("%s: unknown poll group '%s'\n", driverName, groupName);
+		return asynError;
+	}
+
+	lock();
+	if (periodMs > 0 && group != LINKAM_POLL_ONCE)
+		groupPeriod[group] = periodMs / 1000.0;
+
+	for (i = 0; i < nParams; i++) {
+		index = findReadback(paramNames[i]);
+		if (index < 0)
+			status = asynError;
+		else
+			readbacks[index].group = group;
+	}
+	refreshPending = true;
+	unlock();
+
+	return status;
+}
+
+//
+// \brief     Only publish float readbacks when they move by more than a deadband.
+// \param[in] deadband      Smallest change that is published, 0 publishes every change.
+// \param[in] refreshMs     Publish at least this often (ms) anyway, ignored if <= 0.
+// \param[in] nParams       Number of entries in paramNames.
+// \param[in] paramNames    asyn parameter names (e.g. LINKAM_TEMP) to apply the deadband to.
+//
+asynStatus linkamPortDriver::setDeadband(double deadband, int refreshMs, int nParams, char **paramNames)
+{
+	asynStatus status = asynSuccess;
+	int index, i;
+
+	lock();
+	for (i = 0; i < nParams; i++) {
+		index = findReadback(paramNames[i]);
+		if (index < 0) {
+			status = asynError;
+			continue;
+		}
+		if (readbacks[index].paramType != asynParamFloat64) {
+			printf("%s: parameter '%s' is not a float readback\n", driverName, paramNames[i]);
+			status = asynError;
+			continue;
+		}
+		readbacks[index].deadband = deadband > 0 ? deadband : 0.0;
+		if (refreshMs > 0)
+			readbacks[index].refreshPeriod = refreshMs / 1000.0;
+	}
+	unlock();
+
+	return status;
+}
+
+//
+// \brief     Look up a polled readback by asyn parameter name.
+// \return    Index into readbacks, or -1 (with a message) if it is not a polled readback.
+//
+int linkamPortDriver::findReadback(const char *paramName)
+{
+	int param;
+	size_t i;
+
+	if (findParam(paramName, &param) != asynSuccess) {
+		printf("%s: unknown parameter '%s'\n", driverName, paramName);
+		return -1;
+	}
+	for (i = 0; i < readbacks.size(); i++) {
+		if (readbacks[i].param == param)
+			return i;
+	}
+	printf("%s: parameter '%s' is not a polled readback\n", driverName, paramName);
+	return -1;
+}
+
+//
+// \brief     Ask the SDK to open the connection described by commsInfo and return without
+//            waiting for the controller, so IOC startup is not held up by it and several
+//            controllers connect in parallel. The SDK's connected event completes the connection.
+//            The SDK writes the handle into a local, which is only published, under statusMutex,
+//            once the request has returned; a connected event that came before then is claimed here.
+// \return    false if the SDK refused the request, the port then stays disconnected.
+//
+bool linkamPortDriver::openComms(void)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant result;
+	CommsHandle opened = 0;
+	std::vector<CommsHandle>::iterator early;
+	bool ok, connected;
+
+	epicsMutexLock(statusMutex);
+	openPending = true;
+	sdkHandle = 0;
+	epicsMutexUnlock(statusMutex);
+
+	param1.vPtr = &commsInfo;
+	param2.vPtr = &opened;
+	result.vUint64 = 0;
+	ok = linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_OpenCommsNonBlocking, 0, &result, param1, param2);
+	if (!ok || (!result.vConnectionStatus.flags.connected && result.vConnectionStatus.value != 0)) {
+		epicsMutexLock(statusMutex);
+		openPending = false;
+		epicsMutexUnlock(statusMutex);
+		printErrorConnectionStatus(result);
+		return false;
+	}
+
+	// Under driversMutex, so the connected event is either already kept or finds the handle
+	epicsMutexLock(driversMutex);
+	epicsMutexLock(statusMutex);
+	sdkHandle = opened;
+	epicsMutexUnlock(statusMutex);
+	early = std::find(earlyConnects.begin(), earlyConnects.end(), opened);
+	// Already there, in case the SDK raised no event for it
+	connected = result.vConnectionStatus.flags.connected || early != earlyConnects.end();
+	if (early != earlyConnects.end())
+		earlyConnects.erase(early);
+	if (connected)
+		controllerConnected(opened);
+	epicsMutexUnlock(driversMutex);
+	printf("%s: %s waiting for the controller\n", driverName, portName);
+	return true;
+}
+
+//
+// \brief     Have the acquisition thread re-read, on its next pass rather than when their poll
+//            group is due, the readback of a stage value just written and the settings that
+//            share its status flags. Called with the port locked, after a successful write.
+//
+void linkamPortDriver::refreshWritten(LinkamSDK::StageValueType valueType)
+{
+	uint64_t related = 0;
+	size_t i;
+
+	for (i = 0; i < readbacks.size(); i++) {
+		if (readbacks[i].valueType == valueType) {
+			readbacks[i].writeRefresh = true;
+			related |= readbacks[i].statusMask;
+		}
+	}
+	for (i = 0; related && i < readbacks.size(); i++) {
+		if (readbacks[i].statusMask & related)
+			readbacks[i].writeRefresh = true;
+	}
+	epicsEventSignal(newValueEvent);
+}
+
+//
+// \brief     Serial number of the USB controller the port is bound to, empty otherwise.
+//
+const char *linkamPortDriver::usbSerial(void) const
+{
+	if (commsInfo.type != LinkamSDK::eCommsTypeUSB)
+		return "";
+	return ((const LinkamSDK::USBCommsInfo *)commsInfo.info)->serialNumber;
+}
+
+void linkamPortDriver::printErrorConnectionStatus(LinkamSDK::Variant connectionResult)
+{
+	const LinkamSDK::ConnectionStatus &status = connectionResult.vConnectionStatus;
+
+	printf( "%s: %s error opening connection:\n\nstatus.connected = %d\nstatus.flags.errorAllocationFailed = %d\n"
+	        "status.flags.errorAlreadyOpen = %d\nstatus.flags.errorCommsStreams = %d\n"
+			"status.flags.errorHandleRegistrationFailed = %d\nstatus.flags.errorMultipleDevicesFound = %d\n"
+			"status.flags.errorNoDeviceFound = %d\nstatus.flags.errorPortConfig = %d\n"
+			"status.flags.errorPropertiesIncorrect = %d\nstatus.flags.errorSerialNumberRequired = %d\n"
+			"status.flags.errorTimeout = %d\nstatus.flags.errorUnhandled = %d\n\n",
+			driverName, portName,
+			status.flags.connected, status.flags.errorAllocationFailed,
+			status.flags.errorAlreadyOpen, status.flags.errorCommsStreams,
+			status.flags.errorHandleRegistrationFailed,
+			status.flags.errorMultipleDevicesFound,
+			status.flags.errorNoDeviceFound, status.flags.errorPortConfig,
+			status.flags.errorPropertiesIncorrect, status.flags.errorSerialNumberRequired,
+			status.flags.errorTimeout, status.flags.errorUnhandled);
+}
+
+//
+// \brief     Send a message to the controller, or answer it from the recorded run when replaying.
+//            Every call is timed into the latency histograms.
+//
+bool linkamPortDriver::processMessage(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant *result,
+                                      LinkamSDK::Variant param1, LinkamSDK::Variant param2, LinkamSDK::Variant param3)
+{
+	uint64_t start = linkamStats::now();
+	bool ok;
+
+	if (replay)
+		ok = replayMessage(msg, result, param1, param2);
+	else if (commsOpen)
+		ok = linkamProcessMessage(msg, handle, result, param1, param2, param3);
+	else
+		ok = false;
+	stats.record(msg, param1, start, ok);
+	return ok;
+}
+
+//
+// \brief     Answer a message from the recorded run. Readbacks and the controller status come
+//            from the latest replayed record; values that were not recorded, configuration and
+//            error queries fail, so their records go invalid. Commands are accepted and ignored.
+//
+bool linkamPortDriver::replayMessage(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant *result,
+                                     LinkamSDK::Variant param1, LinkamSDK::Variant param2)
+{
+	double value;
+	size_t i;
+
+	switch (msg) {
+	case LinkamSDK::eLinkamFunctionMsgCode_GetValue:
+		for (i = 0; i < readbacks.size(); i++) {
+			if (readbacks[i].valueType == param1.vStageValueType)
+				break;
+		}
+		if (i == readbacks.size() || !replay->value(i, &value))
+			return false;
+		linkamSetVariantValue(*result, readbacks[i].valueKind, value);
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStatus:
+		result->vControllerStatus.value = replay->status();
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerName:
+		strncpy((char *)param1.vPtr, "Replay", param2.vUint32);
+		((char *)param1.vPtr)[param2.vUint32 - 1] = '\0';
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerSerial:
+		strncpy((char *)param1.vPtr, replay->name(), param2.vUint32);
+		((char *)param1.vPtr)[param2.vUint32 - 1] = '\0';
+		return true;
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageName:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageSerial:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerFirmwareVersion:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerHardwareVersion:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerError:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetControllerConfig:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageConfig:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetStageType:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetOptionCardType:
+	case LinkamSDK::eLinkamFunctionMsgCode_GetDataRate:
+		return false;
+	default:
+		result->vBoolean = true;
+		return true;
+	}
+}
+
+void linkamPortDriver::report(FILE *fp, int details)
+{
+	const char *paramName;
+	int group;
+	size_t i;
+
+	fprintf(fp, "  Capabilities:%s%s%s%s\n",
+		(capabilities & LINKAM_CAP_LNP) ? " lnp" : "",
+		(capabilities & LINKAM_CAP_DSC) ? " dsc" : "",
+		(capabilities & LINKAM_CAP_VACUUM) ? " vacuum" : "",
+		(capabilities & LINKAM_CAP_TENSILE) ? " tensile" : "");
+	for (group = 0; group < LINKAM_NUM_POLL_GROUPS; group++) {
+		if (group == LINKAM_POLL_ONCE)
+			fprintf(fp, "  Poll group %-6s\n", pollGroupNames[group]);
+		else
+			fprintf(fp, "  Poll group %-6s period %.0f ms\n", pollGroupNames[group], groupPeriod[group] * 1000.0);
+		if (details < 1)
+			continue;
+		for (i = 0; i < readbacks.size(); i++) {
+			if (readbacks[i].group != group || getParamName(readbacks[i].param, &paramName) != asynSuccess)
+				continue;
+			fprintf(fp, "    %s", paramName);
+			if (readbacks[i].deadband > 0)
+				fprintf(fp, " deadband %g refresh %.0f ms", readbacks[i].deadband, readbacks[i].refreshPeriod * 1000.0);
+			fprintf(fp, "%s\n", (readbacks[i].capability & ~capabilities) ? " (not fitted)" : "");
+		}
+	}
+	recorder->report(fp);
+	if (replay)
+		replay->report(fp);
+	if (details >= 1)
+		stats.report(fp);
+	asynPortDriver::report(fp, details);
+}
 
-	
-    createParam(P_TstfValString, asynParamFloat64, &P_TstfVal);
+asynStatus linkamPortDriver::readFloat64Array(asynUser *pasynUser, epicsFloat64 *value, size_t nElements, size_t *nIn)
+{
+	int function = pasynUser->reason;
+	int trace;
 
+	for (trace = 0; trace < LINKAM_NUM_HIST; trace++) {
+		if (function == historyParams[trace]) {
+			*nIn = copyHistory(trace, value, nElements);
+			return asynSuccess;
+		}
+	}
+	for (trace = 0; trace < LINKAM_NUM_CAPTURE; trace++) {
+		if (function == captureParams[trace]) {
+			*nIn = std::min(captureCount, nElements);
+			std::copy(capture[trace].begin(), capture[trace].begin() + *nIn, value);
+			return asynSuccess;
+		}
+	}
+	for (trace = 0; trace < LINKAM_NUM_STATS; trace++) {
+		if (function == statsParams[trace]) {
+			*nIn = std::min(statsOut[trace].size(), nElements);
+			std::copy(statsOut[trace].begin(), statsOut[trace].begin() + *nIn, value);
+			return asynSuccess;
+		}
+	}
+	return asynPortDriver::readFloat64Array(pasynUser, value, nElements, nIn);
 }
 
 asynStatus linkamPortDriver::readFloat64(asynUser *pasynUser, epicsFloat64 *value)
 {
-	LinkamSDK::Variant param1;
-	LinkamSDK::Variant param2;
-	LinkamSDK::Variant result;
 	int function = pasynUser->reason;
 	epicsTimeStamp timeStamp;
 	const char *functionName = "readFloat64";
@@ -141,75 +1918,13 @@ asynStatus linkamPortDriver::readFloat64(asynUser *pasynUser, epicsFloat64 *valu
 	getTimeStamp(&timeStamp);
 	pasynUser->timestamp = timeStamp;
 
-	if (function == P_Temp) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeHeater1Temp;
-	} else if (function == P_RampRate) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeHeaterRate;
-	} else if (function == P_Setpoint) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeHeaterSetpoint;
-	} else if (function == P_Power) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeHeater1Power;
-	} else if (function == P_LNPSpeed) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeHeater1LNPSpeed;
-	} else if (function == P_DSC) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeDsc;
-	} else if (function == P_HoldTimeLeft) {
-    	param1.vStageValueType = LinkamSDK::eStageValueTypeRampHoldRemaining;
-	} else if (function == P_VacuumChamber) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeVacuum;
-	} else if (function == P_VacuumData1) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeVacuumOptionBoardSensor1Data;
-	} else if (function == P_TstMtrVel) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstMotorVel;
-    } else if (function == P_TstMotorPos) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstMotorPos;
-    } else if (function == P_Force) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstForce;
-    } else if (function == P_ForceSetpoint) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstForceSetpoint;
-    } else if (function == P_TstMaxJawPos){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstMaxExtentPosition;
-    } else if (function == P_TstMinJawPos){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstMinExtentPosition;
-    } else if (function == P_ForceGauge){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstForceGauge;
-    } else if (function == P_JawToJawSize){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstJawToJawSize;
-    } else if (function == P_JawPosition){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstJawPosition;
-    } else if (function == P_Strain){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstStrain;
-    } else if (function == P_Stress){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstStress;
-    } else if (function == P_TstDefaultMtrSpeed) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeMotorTstDefaultSpeed;
-    } else if (function == P_TstRawMotorPos) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstRawMotorPos;
-    } else if (function == P_TstMtrDistSP) {
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint;
-    } else if (function == P_TstpVelo){
+	if (function == P_TstpVelo){
 		*value = pMotorParams.demandVelocity;
-		return status;
 	} else if (function == P_TstpVal){
 		*value = pMotorParams.demandPosition;
-		return status;
-	} else if (function == P_TstForceKp){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstPidKp;
-	} else if (function == P_TstForceKi){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstPidKi;
-	} else if (function == P_TstForceKd){
-		param1.vStageValueType = LinkamSDK::eStageValueTypeTstPidKd;
-	}
-
-	if (linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, handle, &result, param1, param2)){
-		*value = result.vFloat32;
-
-		if(function == P_JawToJawSize)
-			setDoubleParam(P_JawToJawSize,*value);
-
-
-	}else{
-		status = asynError;
+	} else {
+		// Readbacks refreshed by the acquisition thread are served from the parameter library
+		return asynPortDriver::readFloat64(pasynUser, value);
 	}
 
 	if (status)
@@ -224,79 +1939,9 @@ asynStatus linkamPortDriver::readFloat64(asynUser *pasynUser, epicsFloat64 *valu
 	return status;
 }
 
-asynStatus linkamPortDriver::readOctet(asynUser *pasynUser, char *value, size_t maxChars, size_t *nActual, int *eomReason)
-{
-	LinkamSDK::Variant param1;
-	LinkamSDK::Variant param2;
-	LinkamSDK::Variant result;
-	enum LinkamSDK::LinkamFunctionMsgCode linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetControllerName;
-	char string[256];
-	int function = pasynUser->reason;
-	epicsTimeStamp timeStamp;
-	const char *functionName = "readOctet";
-	(void)functionName;
-	asynStatus status = asynSuccess;
-
-	getTimeStamp(&timeStamp);
-	pasynUser->timestamp = timeStamp;
-
-	if (function == P_Serial) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetControllerSerial;
-	} else if (function == P_Name) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetControllerName;
-	} else if (function == P_StageSerial) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetStageSerial;
-	} else if (function == P_StageName) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetStageName;
-	} else if (function == P_FirmVer) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetControllerFirmwareVersion;
-	} else if (function == P_HardVer) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetControllerHardwareVersion;
-	} else if (function == P_CtrllrError) {
-		linkamMsgCode = LinkamSDK::eLinkamFunctionMsgCode_GetControllerError;
-	}
-
-  if(function == P_CtrllrError){
-	  if (linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetControllerError, handle, &result)) {
-      strcpy(value, LinkamSDK::ControllerErrorStrings[result.vControllerError]);
-
-		  *nActual = strlen(value) + 1;
-		  *eomReason = 0;
-
-	  } else {
-		  status = asynError;
-	  }
-  } else {
-	  result.vUint64 = 0;
-	  param1.vPtr = string;
-	  param2.vUint32 = 256;
-	  if (linkamProcessMessage(linkamMsgCode, handle, &result, param1, param2)) {	  		  
-      rtrim(string);	  
-		  setStringParam(function, string);
-
-		  *nActual = strlen(string) + 1;
-		  *eomReason = 0;
-
-	  } else {
-		  status = asynError;
-	  }
-  }
-
-	if (status)
-		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-			"%s:%s: status=%d, function=%d",
-			driverName, functionName, status, function);
-	else
-		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
-			"%s:%s: function=%d\n",
-			driverName, functionName, function);
-
-	return status; 
-}
-
 void linkamPortDriver::rtrim(char *s) {
 	int i;
-	for (i = strlen(s); s[i-1] == ' ' || s[i-1] == '\t'; --i)
+	for (i = strlen(s); i > 0 && (s[i-1] == ' ' || s[i-1] == '\t'); --i)
 		;
 	s[i] = '\0';
 }
@@ -306,13 +1951,18 @@ asynStatus linkamPortDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 valu
 	LinkamSDK::Variant param1;
 	LinkamSDK::Variant param2;
 	LinkamSDK::Variant result;
+	const LinkamParamInfo *info;
 	int linkamStatus = 0;
 	int function = pasynUser->reason;
 	const char *functionName = "writeFloat64";
 	asynStatus status = asynSuccess;
 
 	// Process functions that do not require hardware interaction
-	if (function == P_TstpVelo) {
+	if (function == P_TimeStampOffset) {
+		setDoubleParam(P_TimeStampOffset, value);
+		callParamCallbacks();
+		return status;
+	} else if (function == P_TstpVelo) {
 		pMotorParams.demandVelocity = value;
 		return status;
 	} else if(function == P_TstpVal) {
@@ -325,40 +1975,19 @@ asynStatus linkamPortDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 valu
 		return status;
 	}
 
-	if (function == P_RampRateSet) {
-        	param1.vStageValueType = LinkamSDK::eStageValueTypeHeaterRate;
-	} else if (function == P_SetpointSet) {
-        	param1.vStageValueType = LinkamSDK::eStageValueTypeHeaterSetpoint;
-	} else if (function == P_HoldTimeSet) {
-        	param1.vStageValueType = LinkamSDK::eStageValueTypeRampHoldTime;
-	} else if (function == P_TstMtrVelSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstMotorVel;
-    } else if (function == P_JawToJawSizeSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstJawToJawSize;
-    } else if (function == P_TstMaxJawPosSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstMaxExtentPosition;
-    } else if (function == P_TstMinJawPosSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstMinExtentPosition;
-    } else if (function == P_TstDefaultMtrSpeedSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeMotorTstDefaultSpeed;
-    } else if (function == P_ForceSetpointSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstForceSetpoint;
-    } else if (function == P_TstMtrDistSPSet) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint;
-    } else if (function == P_TstForceKp) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstPidKp;
-    } else if (function == P_TstForceKi) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstPidKi;
-    } else if (function == P_TstForceKd) {
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstPidKd;
-    }
-
-
-	param2.vFloat32 = value;
-	linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, handle, &result, param1, param2);
+	// Everything else is a stage value written with SetValue
+	info = findParamInfo(function);
+	if (!info || !(info->access & LINKAM_ACCESS_WRITE) || info->type != asynParamFloat64)
+		return asynPortDriver::writeFloat64(pasynUser, value);
+	param1.vStageValueType = info->valueType;
+	linkamSetVariantValue(param2, info->valueKind, value);
+	processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, &result, param1, param2);
 
 	if (!result.vBoolean) {
 		status = asynError;
+	} else {
+		settings[function] = value;
+		refreshWritten(info->valueType);
 	}
 
 	/*
@@ -372,8 +2001,8 @@ asynStatus linkamPortDriver::writeFloat64(asynUser *pasynUser, epicsFloat64 valu
 		// If heater is on, resend eLinkamFunctionMsgCode_StartHeating
 		if((linkamStatus & 4) == 4 ){
 			param2.vBoolean = true;
-			linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_StartHeating,
-								handle, &result, param2);
+			processMessage(LinkamSDK::eLinkamFunctionMsgCode_StartHeating,
+								&result, param2);
 		}
 	}
 
@@ -395,10 +2024,42 @@ asynStatus linkamPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 	LinkamSDK::Variant param2;
 	LinkamSDK::Variant param3;
 	LinkamSDK::Variant result;
+	const LinkamParamInfo *info;
 	int function = pasynUser->reason;
 	const char *functionName = "writeInt32";
 	asynStatus status = asynSuccess;
 
+	// Process functions that do not require hardware interaction
+	if (function == P_HistDecimation) {
+		setIntegerParam(P_HistDecimation, value > 0 ? value : 1);
+		callParamCallbacks();
+		return status;
+	} else if (function == P_HistReset) {
+		resetHistory();
+		publishHistory();
+		callParamCallbacks();
+		return status;
+	} else if (function == P_RecStart) {
+		char fileName[256];
+
+		// The writer thread opens the file, so this returns straight away
+		getStringParam(P_RecFilename, sizeof(fileName), fileName);
+		if (!recorder->start(fileName))
+			status = asynError;
+		publishRecorder();
+		callParamCallbacks();
+		return status;
+	} else if (function == P_RecStop) {
+		recorder->stop();
+		publishRecorder();
+		callParamCallbacks();
+		return status;
+	} else if (function == P_StatsReset) {
+		stats.reset();
+		publishStats();
+		return status;
+	}
+
 	if (function == P_StartHeating) {
 		param2.vUint64 = 0; /* unused */
 
@@ -409,8 +2070,8 @@ asynStatus linkamPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 			param1.vBoolean = false;
 		}
 
-		linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_StartHeating,
-		                     handle, &result, param1, param2);
+		processMessage(LinkamSDK::eLinkamFunctionMsgCode_StartHeating,
+		               &result, param1, param2);
 		
 		if (!result.vBoolean) {
 			status = asynError;
@@ -423,14 +2084,14 @@ asynStatus linkamPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 		else
 			LNP_AutoMode = param1.vBoolean = false;
 
-		linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_LnpSetMode, handle, &result, param1, param2);
+		processMessage(LinkamSDK::eLinkamFunctionMsgCode_LnpSetMode, &result, param1, param2);
 
 		if (result.vBoolean) {
 			if (!LNP_AutoMode) { /* Manual Mode, set LNP speed to LNP_ManualSpeed */
 				param1.vUint32 = LNP_ManualSpeed;
 
-				linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_LnpSetSpeed,
-				                     handle, &result, param1, param2);
+				processMessage(LinkamSDK::eLinkamFunctionMsgCode_LnpSetSpeed,
+				               &result, param1, param2);
 			}
 		} else {
 			status = asynError;
@@ -449,7 +2110,7 @@ asynStatus linkamPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
 
 			param1.vUint32 = value;
 
-			linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_LnpSetSpeed, handle, &result, param1, param2);
+			processMessage(LinkamSDK::eLinkamFunctionMsgCode_LnpSetSpeed, &result, param1, param2);
 
 			if (!result.vBoolean) {
 				status = asynError;
@@ -478,23 +2139,18 @@ asynStatus linkamPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
             default:
                 return asynError;
         }
-        if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_TstSetMode, handle, &result, param1, param2)) status = asynError;
+        if(!processMessage(LinkamSDK::eLinkamFunctionMsgCode_TstSetMode, &result, param1, param2)) status = asynError;
+        else refreshWritten(LinkamSDK::eStageValueTypeTstTableMode);
     } else if (function == P_TstStartMotor) {
-        param1.vBoolean = true;
-        if(value == 0)
-            param1.vBoolean = false;
-        // StartMotors function takes 5 as TST motor
-        param2.vInt32 = 5;
-        if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_StartMotors, handle, &result, param1, param2)) status = asynError;
+        if (!runMotor(value != 0)) status = asynError;
+        callParamCallbacks();
 
     } else if (function == P_TstCalibDistance) {
-        if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_TstCalibrateDistance, handle, &result, param1, param2)) status = asynError;
+        if(!processMessage(LinkamSDK::eLinkamFunctionMsgCode_TstCalibrateDistance, &result, param1, param2)) status = asynError;
     } else if (function == P_TstZeroDistance) {
-        if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_TstZeroPosition, handle, &result, param1, param2)) status = asynError;
-        else printf("Success!\n");
-        printf("%d\n", result.vInt32);
+        if(!processMessage(LinkamSDK::eLinkamFunctionMsgCode_TstZeroPosition, &result, param1, param2)) status = asynError;
     } else if (function == P_TstZeroForce) {
-        if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_TstZeroForce, handle, &result, param1, param2)) status = asynError;
+        if(!processMessage(LinkamSDK::eLinkamFunctionMsgCode_TstZeroForce, &result, param1, param2)) status = asynError;
     } else if (function == P_SampleSizeSet){
         param1.vStageValueType = LinkamSDK::eStageValueTypeTstSampleSize;
         double sampleWidth, sampleThickness;
@@ -503,190 +2159,46 @@ asynStatus linkamPortDriver::writeInt32(asynUser *pasynUser, epicsInt32 value)
         LinkamSDK::TSTSampleSize sampleSize;
         sampleSize.thickness = sampleThickness;
         sampleSize.width = sampleWidth;
-        param1.vTSTSampleSize = sampleSize;
-        linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, handle, &result, param1, param2);
+        param2.vTSTSampleSize = sampleSize;
+        processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, &result, param1, param2);
         //printf("Set Sample size is %lf, %lf\n", result.vTSTSampleSize.width, result.vTSTSampleSize.thickness);
         callParamCallbacks();
-    }else {
-
-        bool toProcess = true;
-        if (function == P_ShowForceAsDistSet){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstShowAsForceDistance;
-        } else if (function == P_TstTableDirSet) {
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstTableDirection;
-        } else if (function == P_StrainPercentageSet) {
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstStrainPercentage;
-        } else if (function == P_TstJawMonitorSet) {
-            if (value == 1) param1.vStageValueType = LinkamSDK::eStageValueTypeTstEnableJawMonitor;
-            else param1.vStageValueType = LinkamSDK::eStageValueTypeTstDisableJawMonitor;
-        } else if (function == P_StrainEguSet) {
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstStrainEngineeringUnits;
-        }
-
-        else toProcess = false;
-
-        if (toProcess){
-            param2.vInt32 = value;
-            if (!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, handle, &result, param1, param2)) {
-                status = asynError;
-            }
-        }
-    }
-	if (status)
-		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-			"%s:%s: status=%d, function=%d",
-			driverName, functionName, status, function);
-	else
-		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER,
-			"%s:%s: function=%d\n",
-			driverName, functionName, function);
-
-	return status;
-}
-
-asynStatus linkamPortDriver::readInt32(asynUser *pasynUser, epicsInt32 *value)
-{
-	LinkamSDK::Variant param1;
-	LinkamSDK::Variant param2;
-	LinkamSDK::Variant result;
-	int function = pasynUser->reason;
-	const char *functionName = "readInt32";
-	asynStatus status = asynSuccess;
-	int errorcode;
-
-	if (function == P_CtrlConfig) {
-		if (linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetControllerConfig, handle, &result)) {
-			*value =
-			      /* result.vControllerConfig.flags.supportsHeater                      << 0  |
-				 result.vControllerConfig.flags.supportsDualHeater                  << 1  |
-				 result.vControllerConfig.flags.supportsDualHeaterIndependentLimits << 2  |
-				 result.vControllerConfig.flags.supportsDualHeaterIndependentRates  << 3  |
-				 result.vControllerConfig.flags.vacuumOption                        << 4  |
-				 result.vControllerConfig.flags.tensileForceCardReady               << 5  |*/
-				 result.vControllerConfig.flags.dscCardReady                        << 0  |
-			       /*result.vControllerConfig.flags.xMotorCardReady                     << 7  |
-				 result.vControllerConfig.flags.yMotorCardReady                     << 8  |
-				 result.vControllerConfig.flags.zMotorCardReady                     << 9  |
-				 result.vControllerConfig.flags.motorValveCardReady                 << 7  |
-				 result.vControllerConfig.flags.tensileMotorCardReady               << 8  |
-				 result.vControllerConfig.flags.gradedMotorCardReady                << 9  |
-				 result.vControllerConfig.flags.dtcCardReady                        << 7  |
-				 result.vControllerConfig.flags.cssMotorCardReady                   << 8  |*/
-				 result.vControllerConfig.flags.lnpReady                            << 1/*|
-				 result.vControllerConfig.flags.lnpDualReady                        << 2  |
-				 result.vControllerConfig.flags.humidityReady                       << 3*/;
-		} else {
-			status = asynError;
-		}
-	} else if (function == P_CtrlStatus) {
-		if (linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStatus, handle, &result)) { 
-			*value = result.vControllerStatus.flags.controllerError               << 0  |
-				 result.vControllerStatus.flags.heater1RampSetPoint           << 1  |
-				 result.vControllerStatus.flags.heater1Started                << 2  |
-			       /*result.vControllerStatus.flags.heater2RampSetPoint           << 3  |
-				 result.vControllerStatus.flags.heater2Started                << 4  |
-				 result.vControllerStatus.flags.vacuumRampSetPoint            << 5  |
-				 result.vControllerStatus.flags.vacuumCtrlStarted             << 6  |
-				 result.vControllerStatus.flags.vacuumValveClosed             << 7  |
-				 result.vControllerStatus.flags.vacuumValveOpen               << 8  |
-				 result.vControllerStatus.flags.humidityRampSetPoint          << 3  |
-				 result.vControllerStatus.flags.humidityCtrlStarted           << 4  |*/
-				 result.vControllerStatus.flags.lnpCoolingPumpOn              << 3  |
-				 result.vControllerStatus.flags.lnpCoolingPumpAuto            << 4  |
-			       /*result.vControllerStatus.flags.HumidityDesiccantConditioning << 13 |
-				 result.vControllerStatus.flags.motorTravelMinX               << 14 |
-				 result.vControllerStatus.flags.motorTravelMaxX               << 15 |
-				 result.vControllerStatus.flags.motorStoppedX                 << 16 |
-				 result.vControllerStatus.flags.motorTravelMinY               << 17 |
-				 result.vControllerStatus.flags.motorTravelMaxY               << 18 |
-				 result.vControllerStatus.flags.motorStoppedY                 << 19 |
-				 result.vControllerStatus.flags.motorTravelMinZ               << 20 |
-				 result.vControllerStatus.flags.motorTravelMaxZ               << 21 |
-				 result.vControllerStatus.flags.motorStoppedZ                 << 22 |*/
-				 result.vControllerStatus.flags.sampleCal                     << 5;
-			       /*result.vControllerStatus.flags.motorDistanceCalTST           << 24 |
-				 result.vControllerStatus.flags.cssRotMotorStopped            << 8  |
-				 result.vControllerStatus.flags.cssGapMotorStopped            << 9  |
-				 result.vControllerStatus.flags.cssLidOn                      << 10 |
-				 result.vControllerStatus.flags.cssRefLimit                   << 11 |
-				 result.vControllerStatus.flags.cssZeroLimit                  << 12;*/
-
-			// Set asyn parameter for linkam status for later use
-			setIntegerParam(P_CtrlStatus,*value);
-      if (result.vControllerStatus.flags.controllerError) {
-        errorcode = linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetControllerError, handle, &result);
-        printf("Controller Error %i: %s\n", errorcode, LinkamSDK::ControllerErrorStrings[errorcode]);
-      }
-		} else {
-			status = asynError;
-		}
-	} else if (function == P_StageConfig) {
-		if (linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStageConfig, handle, &result)) {
-			*value = result.vStageConfig.flags.standardStage               << 0  |
-			       /*result.vStageConfig.flags.highTempStage               << 1  |
-				 result.vStageConfig.flags.peltierStage                << 2  |
-				 result.vStageConfig.flags.gradedStage                 << 3  |
-				 result.vStageConfig.flags.tensileStage                << 4  |*/
-				 result.vStageConfig.flags.dscStage                    << 1  |
-			       /*result.vStageConfig.flags.warmStage                   << 6  |
-				 result.vStageConfig.flags.itoStage                    << 7  |
-				 result.vStageConfig.flags.css450Stage                 << 8  |
-				 result.vStageConfig.flags.correlativeStage            << 9  |*/
-				 result.vStageConfig.flags.coolingManual               << 2  |
-				 result.vStageConfig.flags.coolingAutomatic            << 3  |
-			       /*result.vStageConfig.flags.coolingDual                 << 12 |
-				 result.vStageConfig.flags.coolingDualSpeedIndependent << 13 |
-				 result.vStageConfig.flags.heater1                     << 14 |
-				 result.vStageConfig.flags.heater1TempCtrl             << 15 |
-				 result.vStageConfig.flags.heater1TempCtrlProbe        << 16 |
-				 result.vStageConfig.flags.heater2                     << 17 |
-				 result.vStageConfig.flags.heater12IndependentLimits   << 18 |
-				 result.vStageConfig.flags.waterCoolingSensorFitted    << 19 |
-				 result.vStageConfig.flags.home                        << 20 |
-				 result.vStageConfig.flags.supportsVacuum              << 21 |
-				 result.vStageConfig.flags.motorX                      << 22 |
-				 result.vStageConfig.flags.motorY                      << 23 |
-				 result.vStageConfig.flags.motorZ                      << 24 |*/
-				 result.vStageConfig.flags.supportsHumidity            << 4;
-		} else {
-			status = asynError;
-		} 
-	} 
-    else if (function == P_SampleSize){
-        param1.vStageValueType = LinkamSDK::eStageValueTypeTstSampleSize;
-        linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, handle, &result, param1, param2);
-        setDoubleParam(P_SampleWidth, result.vTSTSampleSize.width);
-        setDoubleParam(P_SampleThickness, result.vTSTSampleSize.thickness);
+    } else if (function == P_DataRateSet) {
+        if (value < 0)
+            value = 0;
+        else if (value > 0 && value < 5)
+            value = 5;
+        else if (value > 1000)
+            value = 1000;
+
+        // Kept to be applied again whenever the controller is reconnected
+        setIntegerParam(P_DataRateSet, value);
+        if (replay || commsOpen)
+            status = setDataRate(value);
         callParamCallbacks();
-    }
-    else {
-        bool toProcess = true;
-        if (function == P_TstTableDir){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstTableDirection;
-        } else if (function == P_StrainEgu){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstStrainEngineeringUnits;
-        } else if (function == P_TstTableMode){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstTableMode;
-        } else if (function == P_StrainPercentage){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstStrainPercentage;
-        } else if (function == P_ShowForceAsDist){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstShowAsForceDistance;
-        } else if (function == P_TstJawMonitor){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstIsJawMonitorEnabled;
-        } else if (function == P_TstCycleCountLim){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstCycleCountLimit;
-        } else if (function == P_TstCyclesRemaining){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstCyclesRemaining;
-        } else if (function == P_TstStatus){
-            param1.vStageValueType = LinkamSDK::eStageValueTypeTstStatus;
-        } else toProcess = false;
-
-        if (toProcess) {
-            linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, handle, &result, param1, param2);
-            *value = result.vInt32;
-
-			if (function == P_TstTableMode)
-				setIntegerParam(P_TstTableMode,*value);
+    } else if (function == P_RxTimeoutSet) {
+        if (value < 0)
+            value = 0;
+
+        // Kept to be applied again whenever the controller is reconnected
+        setIntegerParam(P_RxTimeoutSet, value);
+        if (replay || commsOpen)
+            status = setRxTimeout(value);
+        callParamCallbacks();
+    } else if (function == P_TstJawMonitorSet) {
+        // Enabling and disabling are separate stage values
+        if (value == 1) param1.vStageValueType = LinkamSDK::eStageValueTypeTstEnableJawMonitor;
+        else param1.vStageValueType = LinkamSDK::eStageValueTypeTstDisableJawMonitor;
+        param2.vInt32 = value;
+        if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, &result, param1, param2)) status = asynError;
+        else refreshWritten(LinkamSDK::eStageValueTypeTstIsJawMonitorEnabled);
+    } else if ((info = findParamInfo(function)) && (info->access & LINKAM_ACCESS_WRITE) && info->type == asynParamInt32) {
+        param1.vStageValueType = info->valueType;
+        linkamSetVariantValue(param2, info->valueKind, value);
+        if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, &result, param1, param2)) status = asynError;
+        else {
+            settings[function] = value;
+            refreshWritten(info->valueType);
         }
     }
 
@@ -717,21 +2229,16 @@ asynStatus linkamPortDriver::SetTstGotoMode(float position, float vel)
 	double JawToJawZero;
     bool    dirClosing      = true;
 	int currentTableMode = 0;
-    LinkamSDK::Variant result;
-	LinkamSDK::Variant axis;
 
 	asynStatus status = asynSuccess;
-	axis.vInt32 = 5;
 	getDoubleParam(P_JawToJawSize,&JawToJawZero);
 	getIntegerParam(P_TstTableMode,&currentTableMode);
 	//JawToJawZero = (float)JawToJawZeroD;
 
     // Compute the direction and step to travel for a goto. 'position' will be an absolute
     // distance to obtain, not a relative distance to travel in this case.
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstJawToJawSize), 0, 0);
-    j2j = result.vFloat32;
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstRawMotorPos), 0, 0);
-    cur = result.vFloat32;
+    getValue<LinkamSDK::eStageValueTypeTstJawToJawSize>(&j2j);
+    getValue<LinkamSDK::eStageValueTypeTstRawMotorPos>(&cur);
     // JawToJawZero is the calibrated zero position/distance. By default, this is 15000um, but you may wish to allow users to calibrate this
     // to acommodate larger jigs to be installed (bolt-on bits to the jaws). This will adjust how close the jaws can get. This will need to be
     // accounted for in the positional calculation.
@@ -741,15 +2248,17 @@ asynStatus linkamPortDriver::SetTstGotoMode(float position, float vel)
 
 	// If in force mode, issue a stop command first
 	if(currentTableMode == 3){
-    	linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstTableMode),             LinkamSDK::Variant(LinkamSDK::eTSTMode_Stop),0);
+    	setValue<LinkamSDK::eStageValueTypeTstTableMode>(LinkamSDK::eTSTMode_Stop);
         epicsThreadSleep(0.5);
 	}
 
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstTableDirection),        LinkamSDK::Variant(dirClosing),0);
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstTableMode),             LinkamSDK::Variant(LinkamSDK::eTSTMode_Step),0);
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstMotorVel),              LinkamSDK::Variant(vel),0);
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint), LinkamSDK::Variant(step),0);
-    linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_StartMotors, handle, &result, LinkamSDK::Variant(true),axis,0);
+    if(!setValue<LinkamSDK::eStageValueTypeTstTableDirection>(dirClosing)) status = asynError;
+    if(!setValue<LinkamSDK::eStageValueTypeTstTableMode>(LinkamSDK::eTSTMode_Step)) status = asynError;
+    if(!setValue<LinkamSDK::eStageValueTypeTstMotorVel>(vel)) status = asynError;
+    if(!setValue<LinkamSDK::eStageValueTypeTstMotorDistanceSetpoint>(step)) status = asynError;
+    if (!runMotor(true)) status = asynError;
+	callParamCallbacks();
+	return status;
 }
 
 //
@@ -759,28 +2268,26 @@ asynStatus linkamPortDriver::SetTstGotoMode(float position, float vel)
 asynStatus linkamPortDriver::SetTstForceMode(float force)
 {
 	asynStatus status = asynSuccess;
-    LinkamSDK::Variant result;
-	LinkamSDK::Variant axis;
-	axis.vInt32 = 5;
-    if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstTableMode),     LinkamSDK::Variant(LinkamSDK::eTSTMode_Force), 0)) status= asynError;
-    if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue,    handle, &result, LinkamSDK::Variant(LinkamSDK::eStageValueTypeTstForceSetpoint), LinkamSDK::Variant(force), 0)) status= asynError;
-    if(!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_StartMotors, handle, &result, LinkamSDK::Variant(true),axis,0)) status= asynError;
+    if(!setValue<LinkamSDK::eStageValueTypeTstTableMode>(LinkamSDK::eTSTMode_Force)) status= asynError;
+    if(!setValue<LinkamSDK::eStageValueTypeTstForceSetpoint>(force)) status= asynError;
+    if (!runMotor(true)) status = asynError;
+	callParamCallbacks();
 	return status;
 }
 
 
-/*
- * linkamStatus
- */
-static const iocshArg * const linkamStatus_Args[0] = {};
-static const iocshFuncDef linkamStatus_FuncDef = { "linkamStatus", 0, linkamStatus_Args };
-
-static void linkamStatus_CallFunc(const iocshArgBuf *args)
+//
+// \brief     Print the controller status flags of this port's controller.
+//
+void linkamPortDriver::printLinkam3Status()
 {
-	(void)args;
 	LinkamSDK::Variant result;
-	linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStatus, handle, &result);
 
+	printf("%s:\n", portName);
+	if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetStatus, &result)) {
+		printf("  controller status not available\n");
+		return;
+	}
 	printf("controllerError               = %d\n", result.vControllerStatus.flags.controllerError);
 	printf("heater1RampSetPoint           = %d\n", result.vControllerStatus.flags.heater1RampSetPoint);
 	printf("heater1Started                = %d\n", result.vControllerStatus.flags.heater1Started);
@@ -813,6 +2320,29 @@ static void linkamStatus_CallFunc(const iocshArgBuf *args)
 	printf("cssZeroLimit                  = %d\n", result.vControllerStatus.flags.cssZeroLimit);
 }
 
+/*
+ * linkamStatus
+ */
+static const iocshArg linkamStatus_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg * const linkamStatus_Args[] = { &linkamStatus_Arg0 };
+static const iocshFuncDef linkamStatus_FuncDef = { "linkamStatus", 1, linkamStatus_Args };
+
+static void linkamStatus_CallFunc(const iocshArgBuf *args)
+{
+	size_t i;
+	bool found = false;
+
+	// Every port unless one is named
+	for (i = 0; i < drivers.size(); i++) {
+		if (args[0].sval && args[0].sval[0] && strcmp(drivers[i]->portName, args[0].sval) != 0)
+			continue;
+		drivers[i]->printLinkam3Status();
+		found = true;
+	}
+	if (!found && args[0].sval && args[0].sval[0])
+		printf("linkamStatus: no Linkam port named '%s'\n", args[0].sval);
+}
+
 
 /*
  * linkamConnect
@@ -821,20 +2351,60 @@ static const iocshArg linkamConnect_Arg0 = { "asynPort", iocshArgString };
 static const iocshArg linkamConnect_Arg1 = { "serialPort", iocshArgString };
 static const iocshArg linkamConnect_Arg2 = { "logpath", iocshArgString };
 static const iocshArg linkamConnect_Arg3 = { "licPath", iocshArgString };
-static const iocshArg * const linkamConnect_Args[] = { &linkamConnect_Arg0, &linkamConnect_Arg1, &linkamConnect_Arg2 , &linkamConnect_Arg3};
-static const iocshFuncDef linkamConnect_FuncDef = { "linkamConnect", 4, linkamConnect_Args };
+static const iocshArg linkamConnect_Arg4 = { "pollPeriodMs", iocshArgInt };
+static const iocshArg linkamConnect_Arg5 = { "dataRateMs", iocshArgInt };
+static const iocshArg linkamConnect_Arg6 = { "replayFile", iocshArgString };
+static const iocshArg linkamConnect_Arg7 = { "replaySpeed", iocshArgDouble };
+static const iocshArg linkamConnect_Arg8 = { "emulatedStage", iocshArgString };
+static const iocshArg linkamConnect_Arg9 = { "emulatedLNP", iocshArgInt };
+static const iocshArg linkamConnect_Arg10 = { "emulatedRH", iocshArgInt };
+static const iocshArg linkamConnect_Arg11 = { "usbSerial", iocshArgString };
+static const iocshArg linkamConnect_Arg12 = { "baudRate", iocshArgInt };
+static const iocshArg linkamConnect_Arg13 = { "msgTimeoutMs", iocshArgInt };
+static const iocshArg linkamConnect_Arg14 = { "portTimeoutMs", iocshArgInt };
+static const iocshArg * const linkamConnect_Args[] = { &linkamConnect_Arg0, &linkamConnect_Arg1, &linkamConnect_Arg2 , &linkamConnect_Arg3, &linkamConnect_Arg4, &linkamConnect_Arg5,
+                                                       &linkamConnect_Arg6, &linkamConnect_Arg7, &linkamConnect_Arg8, &linkamConnect_Arg9,
+                                                       &linkamConnect_Arg10, &linkamConnect_Arg11, &linkamConnect_Arg12, &linkamConnect_Arg13,
+                                                       &linkamConnect_Arg14};
+static const iocshFuncDef linkamConnect_FuncDef = { "linkamConnect", 15, linkamConnect_Args };
+
+// Stage types the SDK can emulate, by the name given to linkamConnect
+static const struct {
+	const char *name;
+	LinkamSDK::StageType type;
+} emulatedStages[] = {
+	{ "standard",      LinkamSDK::eStageType_Standard },
+	{ "peltier",       LinkamSDK::eStageType_Peltier },
+	{ "gradient",      LinkamSDK::eStageType_Gradient },
+	{ "dsc",           LinkamSDK::eStageType_DifferentialScanningCalorimetry },
+	{ "vacuum",        LinkamSDK::eStageType_Vacuum },
+	{ "pressure",      LinkamSDK::eStageType_Pressure },
+	{ "motor",         LinkamSDK::eStageType_MotorDriven },
+	{ "tensile",       LinkamSDK::eStageType_TensileTest },
+	{ "css",           LinkamSDK::eStageType_CambridgeShearingSystem },
+	{ "thermocoupled", LinkamSDK::eStageType_Thermocoupled },
+	{ "correlative",   LinkamSDK::eStageType_CorrelativeMicroscopy },
+	{ "tcvacuum",      LinkamSDK::eStageType_ThermocoupledVacuum },
+	{ "tensile2",      LinkamSDK::eStageType_TensileTestV2 },
+	{ "dsc2",          LinkamSDK::eStageType_DifferentialScanningCalorimetryV2 },
+	{ "fdvs",          LinkamSDK::eStageType_FreezeDryingVialSystem },
+	{ "plunger",       LinkamSDK::eStageType_Plunger }
+};
 
-static void linkamConnect_CallFunc(const iocshArgBuf *args)
+//
+// \brief     Set up the SDK shared by every port, the first call does the work.
+//
+static void initialiseSDK(const char *logpath, const char *licPath)
 {
-	LinkamSDK::CommsInfo info;
+	static bool sdkInitialised = false;
 	LinkamSDK::Variant param1;
 	LinkamSDK::Variant param2;
 	LinkamSDK::Variant result;
+	char version[256];
 
-	const char *logpath = args[2].sval;
-	const char *licPath = args[3].sval;
-
-	if (!strcmp(logpath, "/dev/null")) {
+	if (sdkInitialised)
+		return;
+	if (logpath && !strcmp(logpath, "/dev/null")) {
 		linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_DisableLogging, 0, &result, param1, param2);
 	}
 	printf("Initialising SDK\n");
@@ -843,45 +2413,397 @@ static void linkamConnect_CallFunc(const iocshArgBuf *args)
 	else
 		printf("LinkamT96: ERROR @ linkamInitialiseSDK\n");
 
-	char version[256];
 	linkamGetVersion(version, 256);
 	printf("Linkam SDK version: %s\n", version);
-	if (strlen(args[1].sval) == 0) {
-		linkamInitialiseUSBCommsInfo(&info, NULL);
+	sdkInitialised = true;
+}
+
+//
+// \brief     Controllers on USB that the SDK can open, with their serial numbers.
+// \return    false if the SDK could not enumerate the bus.
+//
+static bool discoverUSBDevices(std::vector<LinkamSDK::USBDeviceInfo> &devices)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant result;
+	uint32_t count;
+
+	devices.clear();
+	if (!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_DiscoverUSBDeviceCount, 0, &result, param1, param2))
+		return false;
+	count = result.vUint32;
+	if (count == 0)
+		return true;
+
+	devices.resize(count);
+	memset((void *)&devices[0], 0, count * sizeof(devices[0]));
+	param1.vPtr = &devices[0];
+	param2.vUint32 = count;
+	result.vUint64 = 0;
+	if (!linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_GetUSBDeviceDetailsList, 0, &result, param1, param2)) {
+		devices.clear();
+		return false;
+	}
+	// A controller unplugged between the two calls is not listed
+	devices.resize(std::min(count, result.vUint32));
+	for (size_t i = 0; i < devices.size(); i++) {
+		devices[i].serialNumber[sizeof(devices[i].serialNumber) - 1] = '\0';
+		devices[i].manufacturerName[sizeof(devices[i].manufacturerName) - 1] = '\0';
+		devices[i].productName[sizeof(devices[i].productName) - 1] = '\0';
+	}
+	return true;
+}
+
+// Port already bound to the controller with this USB serial number, or NULL
+static linkamPortDriver *findUSBPort(const char *serialNumber)
+{
+	size_t i;
+
+	for (i = 0; i < drivers.size(); i++) {
+		if (serialNumber[0] && strcmp(drivers[i]->usbSerial(), serialNumber) == 0)
+			return drivers[i];
+	}
+	return NULL;
+}
+
+// Port created by linkamConnect with this name, or NULL after saying there is none
+static linkamPortDriver *findPort(const char *portName)
+{
+	size_t i;
+
+	for (i = 0; i < drivers.size(); i++) {
+		if (strcmp(drivers[i]->portName, portName) == 0)
+			return drivers[i];
+	}
+	printf("%s: no Linkam port named '%s'\n", driverName, portName);
+	return NULL;
+}
+
+static void printUSBDevices(const std::vector<LinkamSDK::USBDeviceInfo> &devices)
+{
+	linkamPortDriver *driver;
+	size_t i;
+
+	printf("  %-16s %-9s %-24s %-24s %s\n", "serial", "vid:pid", "manufacturer", "product", "port");
+	for (i = 0; i < devices.size(); i++) {
+		driver = findUSBPort(devices[i].serialNumber);
+		printf("  %-16s %04x:%04x %-24s %-24s %s\n", devices[i].serialNumber, devices[i].vendorID,
+		       devices[i].productID, devices[i].manufacturerName, devices[i].productName,
+		       driver ? driver->portName : "");
+	}
+}
+
+//
+// \brief     linkamInitialiseUSBCommsInfo with the given message timeout, 0 for the SDK default.
+//
+static void initialiseUSBCommsInfo(LinkamSDK::CommsInfo *info, const char *serialNumber, int msgTimeoutMs)
+{
+	if (msgTimeoutMs > 0)
+		linkamInitialiseUSBCommsInfoEx(info, serialNumber, msgTimeoutMs);
+	else
+		linkamInitialiseUSBCommsInfo(info, serialNumber);
+}
+
+//
+// \brief     Fill in the USB connection for linkamConnect, binding the controller with the given
+//            serial number, or the only one on the bus when none is given.
+// \return    false if the choice is ambiguous or the controller is taken, the port is then not created.
+//
+static bool initialiseUSBConnection(LinkamSDK::CommsInfo *info, const char *serialNumber, int msgTimeoutMs)
+{
+	std::vector<LinkamSDK::USBDeviceInfo> devices;
+	linkamPortDriver *driver;
+	size_t i;
+
+	if (!serialNumber)
+		serialNumber = "";
+	if (!discoverUSBDevices(devices)) {
+		// Leave the choice to the SDK, as before discovery
+		printf("linkamConnect: cannot enumerate USB controllers\n");
+		initialiseUSBCommsInfo(info, serialNumber[0] ? serialNumber : NULL, msgTimeoutMs);
+		return true;
+	}
+	printf("linkamConnect: %d USB controller(s) found\n", (int)devices.size());
+	if (!devices.empty())
+		printUSBDevices(devices);
+
+	if (!serialNumber[0]) {
+		if (devices.size() > 1) {
+			printf("linkamConnect: more than one USB controller, give the serial number of the one to use\n");
+			return false;
+		}
+		if (devices.size() == 1)
+			serialNumber = devices[0].serialNumber;
+	} else {
+		for (i = 0; i < devices.size() && strcmp(devices[i].serialNumber, serialNumber) != 0; i++)
+			;
+		if (i == devices.size())
+			printf("linkamConnect: no USB controller with serial number %s found, trying it anyway\n", serialNumber);
+	}
+
+	driver = findUSBPort(serialNumber);
+	if (driver) {
+		printf("linkamConnect: USB controller %s is already used by port %s\n", serialNumber, driver->portName);
+		return false;
+	}
+	initialiseUSBCommsInfo(info, serialNumber[0] ? serialNumber : NULL, msgTimeoutMs);
+	return true;
+}
+
+static void linkamConnect_CallFunc(const iocshArgBuf *args)
+{
+	static bool callbacksRegistered = false;
+	LinkamSDK::CommsInfo info;
+	linkamPortDriver *driver;
+
+	const char *logpath = args[2].sval;
+	const char *licPath = args[3].sval;
+	const char *replayFile = args[6].sval;
+	const char *emulatedStage = args[8].sval;
+	int baudRate = args[12].ival;
+	int msgTimeoutMs = args[13].ival;
+	int portTimeoutMs = args[14].ival;
+	size_t stage = 0;
+	const size_t numEmulatedStages = sizeof(emulatedStages) / sizeof(emulatedStages[0]);
+
+	// Replay a recorded run instead of talking to a controller, no SDK or hardware needed
+	if (replayFile && strlen(replayFile) > 0) {
+		printf("LinkamT96: replaying %s\n", replayFile);
+		addDriver(new linkamPortDriver(args[0].sval, args[4].ival, args[5].ival, NULL, replayFile, args[7].dval));
+		return;
+	}
+
+	if (emulatedStage && strlen(emulatedStage) > 0) {
+		for (stage = 0; stage < numEmulatedStages; stage++) {
+			if (epicsStrCaseCmp(emulatedStage, emulatedStages[stage].name) == 0)
+				break;
+		}
+		if (stage == numEmulatedStages) {
+			printf("linkamConnect: unknown emulated stage '%s', one of:", emulatedStage);
+			for (stage = 0; stage < numEmulatedStages; stage++)
+				printf(" %s", emulatedStages[stage].name);
+			printf("\n");
+			return;
+		}
+	}
+
+	initialiseSDK(logpath, licPath);
+
+	if (emulatedStage && strlen(emulatedStage) > 0) {
+		// The SDK emulates the stage, no controller needed
+		printf("LinkamT96: emulating a %s stage%s%s\n", emulatedStages[stage].name,
+		       args[9].ival ? " with LNP" : "", args[10].ival ? " with humidity" : "");
+		linkamInitialiseEmulatedCommsInfo(&info, emulatedStages[stage].type, args[9].ival != 0, args[10].ival != 0);
+	} else if (!args[1].sval || strlen(args[1].sval) == 0) {
+		if (!initialiseUSBConnection(&info, args[11].sval, msgTimeoutMs))
+			return;
 	} else {
 		linkamInitialiseSerialCommsInfo(&info, args[1].sval);
 
+		// A timeout of 0 keeps the SDK default
 		LinkamSDK::SerialCommsInfo* serial = reinterpret_cast<LinkamSDK::SerialCommsInfo*>(info.info);
-		serial->baudrate = 115200;
+		serial->baudrate = baudRate > 0 ? baudRate : LINKAM_BAUD_RATE;
 		serial->bytesize = (LinkamSDK::ByteSize) 8;
 		serial->flowcontrol = (LinkamSDK::FlowControl) 0;
 		serial->parity = (LinkamSDK::Parity) 0;
 		serial->stopbits = (LinkamSDK::Stopbits) 1;
+		if (msgTimeoutMs > 0)
+			serial->timeout = msgTimeoutMs;
+		if (portTimeoutMs > 0)
+			serial->portTimeout = portTimeoutMs;
 	}
 
-	param1.vPtr = &info;
-	param2.vPtr = &handle;
+	// Readbacks are refreshed when the SDK data thread reports new values, and ports come up
+	// and go down when the SDK reports their controller connected or gone
+	if (!callbacksRegistered) {
+		linkamSetCallbackNewValue(newValueCallback);
+		linkamSetCallbackControllerConnected(connectedCallback);
+		linkamSetCallbackControllerDisconnected(disconnectedCallback);
+		callbacksRegistered = true;
+	}
 
-	linkamProcessMessage(LinkamSDK::eLinkamFunctionMsgCode_OpenComms, 0, &result, param1, param2);
+	// The port keeps its own handle. It is listed before the connection is opened, so the
+	// SDK callbacks find it as soon as the handle is published.
+	driver = new linkamPortDriver(args[0].sval, args[4].ival, args[5].ival, &info);
+	addDriver(driver);
+	driver->openComms();
+}
 
-	if (result.vConnectionStatus.flags.connected) {
-		printf("LinkamT96: We got a connection to the device!\n");
-	} else {
-		printf( "Error openning connection:\n\nstatus.connected = %d\nstatus.flags.errorAllocationFailed = %d\n"
-		        "status.flags.errorAlreadyOpen = %d\nstatus.flags.errorCommsStreams = %d\n"
-				"status.flags.errorHandleRegistrationFailed = %d\nstatus.flags.errorMultipleDevicesFound = %d\n"
-				"status.flags.errorNoDeviceFound = %d\nstatus.flags.errorPortConfig = %d\n"
-				"status.flags.errorPropertiesIncorrect = %d\nstatus.flags.errorSerialNumberRequired = %d\n"
-				"status.flags.errorTimeout = %d\nstatus.flags.errorUnhandled = %d\n\n",
-				result.vConnectionStatus.flags.connected, result.vConnectionStatus.flags.errorAllocationFailed,
-				result.vConnectionStatus.flags.errorAlreadyOpen, result.vConnectionStatus.flags.errorCommsStreams,
-				result.vConnectionStatus.flags.errorHandleRegistrationFailed,
-				result.vConnectionStatus.flags.errorMultipleDevicesFound,
-				result.vConnectionStatus.flags.errorNoDeviceFound, result.vConnectionStatus.flags.errorPortConfig,
-				result.vConnectionStatus.flags.errorPropertiesIncorrect, result.vConnectionStatus.flags.errorSerialNumberRequired,
-				result.vConnectionStatus.flags.errorTimeout, result.vConnectionStatus.flags.errorUnhandled);
-	}
-	new linkamPortDriver(args[0].sval);
+/*
+ * linkamListDevices
+ */
+static const iocshArg linkamListDevices_Arg0 = { "logpath", iocshArgString };
+static const iocshArg linkamListDevices_Arg1 = { "licPath", iocshArgString };
+static const iocshArg * const linkamListDevices_Args[] = { &linkamListDevices_Arg0, &linkamListDevices_Arg1 };
+static const iocshFuncDef linkamListDevices_FuncDef = { "linkamListDevices", 2, linkamListDevices_Args };
+
+static void linkamListDevices_CallFunc(const iocshArgBuf *args)
+{
+	std::vector<LinkamSDK::USBDeviceInfo> devices;
+
+	// Only needed before the first linkamConnect, which otherwise sets the SDK up
+	initialiseSDK(args[0].sval, args[1].sval);
+	if (!discoverUSBDevices(devices)) {
+		printf("linkamListDevices: cannot enumerate USB controllers\n");
+		return;
+	}
+	printf("%d USB controller(s) found\n", (int)devices.size());
+	if (!devices.empty())
+		printUSBDevices(devices);
+}
+
+/*
+ * linkamPollGroup
+ */
+static const iocshArg linkamPollGroup_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg linkamPollGroup_Arg1 = { "group", iocshArgString };
+static const iocshArg linkamPollGroup_Arg2 = { "periodMs", iocshArgInt };
+static const iocshArg linkamPollGroup_Arg3 = { "params", iocshArgArgv };
+static const iocshArg * const linkamPollGroup_Args[] = { &linkamPollGroup_Arg0, &linkamPollGroup_Arg1, &linkamPollGroup_Arg2, &linkamPollGroup_Arg3 };
+static const iocshFuncDef linkamPollGroup_FuncDef = { "linkamPollGroup", 4, linkamPollGroup_Args };
+
+static void linkamPollGroup_CallFunc(const iocshArgBuf *args)
+{
+	linkamPortDriver *driver;
+
+	if (!args[0].sval || !args[1].sval) {
+		printf("Usage: linkamPollGroup asynPort fast|medium|slow|once periodMs [param ...]\n");
+		return;
+	}
+
+	driver = findPort(args[0].sval);
+	if (!driver)
+		return;
+
+	// av[0] is the period token, the parameter names follow it
+	driver->setPollGroup(args[1].sval, args[2].ival, args[3].aval.ac - 1, args[3].aval.av + 1);
+}
+
+/*
+ * linkamDeadband
+ */
+static const iocshArg linkamDeadband_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg linkamDeadband_Arg1 = { "deadband", iocshArgDouble };
+static const iocshArg linkamDeadband_Arg2 = { "refreshMs", iocshArgInt };
+static const iocshArg linkamDeadband_Arg3 = { "params", iocshArgArgv };
+static const iocshArg * const linkamDeadband_Args[] = { &linkamDeadband_Arg0, &linkamDeadband_Arg1, &linkamDeadband_Arg2, &linkamDeadband_Arg3 };
+static const iocshFuncDef linkamDeadband_FuncDef = { "linkamDeadband", 4, linkamDeadband_Args };
+
+static void linkamDeadband_CallFunc(const iocshArgBuf *args)
+{
+	linkamPortDriver *driver;
+
+	if (!args[0].sval) {
+		printf("Usage: linkamDeadband asynPort deadband refreshMs [param ...]\n");
+		return;
+	}
+
+	driver = findPort(args[0].sval);
+	if (!driver)
+		return;
+
+	// av[0] is the refreshMs token, the parameter names follow it
+	driver->setDeadband(args[1].dval, args[2].ival, args[3].aval.ac - 1, args[3].aval.av + 1);
+}
+
+/*
+ * linkamHistory
+ */
+static const iocshArg linkamHistory_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg linkamHistory_Arg1 = { "depth", iocshArgInt };
+static const iocshArg linkamHistory_Arg2 = { "decimation", iocshArgInt };
+static const iocshArg * const linkamHistory_Args[] = { &linkamHistory_Arg0, &linkamHistory_Arg1, &linkamHistory_Arg2 };
+static const iocshFuncDef linkamHistory_FuncDef = { "linkamHistory", 3, linkamHistory_Args };
+
+static void linkamHistory_CallFunc(const iocshArgBuf *args)
+{
+	linkamPortDriver *driver;
+
+	if (!args[0].sval) {
+		printf("Usage: linkamHistory asynPort depth decimation\n");
+		return;
+	}
+
+	driver = findPort(args[0].sval);
+	if (!driver)
+		return;
+
+	if (driver->setHistory(args[1].ival, args[2].ival) != asynSuccess)
+		printf("linkamHistory: depth must not be negative\n");
+}
+
+/*
+ * linkamCapture
+ */
+static const iocshArg linkamCapture_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg linkamCapture_Arg1 = { "depth", iocshArgInt };
+static const iocshArg * const linkamCapture_Args[] = { &linkamCapture_Arg0, &linkamCapture_Arg1 };
+static const iocshFuncDef linkamCapture_FuncDef = { "linkamCapture", 2, linkamCapture_Args };
+
+static void linkamCapture_CallFunc(const iocshArgBuf *args)
+{
+	linkamPortDriver *driver;
+
+	if (!args[0].sval) {
+		printf("Usage: linkamCapture asynPort depth\n");
+		return;
+	}
+
+	driver = findPort(args[0].sval);
+	if (!driver)
+		return;
+
+	if (driver->setCaptureDepth(args[1].ival) != asynSuccess)
+		printf("linkamCapture: depth must not be negative\n");
+}
+
+/*
+ * linkamRecorder
+ */
+static const iocshArg linkamRecorder_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg linkamRecorder_Arg1 = { "fileSizeMB", iocshArgInt };
+static const iocshArg * const linkamRecorder_Args[] = { &linkamRecorder_Arg0, &linkamRecorder_Arg1 };
+static const iocshFuncDef linkamRecorder_FuncDef = { "linkamRecorder", 2, linkamRecorder_Args };
+
+static void linkamRecorder_CallFunc(const iocshArgBuf *args)
+{
+	linkamPortDriver *driver;
+
+	if (!args[0].sval) {
+		printf("Usage: linkamRecorder asynPort fileSizeMB\n");
+		return;
+	}
+
+	driver = findPort(args[0].sval);
+	if (!driver)
+		return;
+
+	if (driver->setRecorderFileSize(args[1].ival) != asynSuccess)
+		printf("linkamRecorder: file size must be positive\n");
+}
+
+/*
+ * linkamStats
+ */
+static const iocshArg linkamStats_Arg0 = { "asynPort", iocshArgString };
+static const iocshArg * const linkamStats_Args[] = { &linkamStats_Arg0 };
+static const iocshFuncDef linkamStats_FuncDef = { "linkamStats", 1, linkamStats_Args };
+
+static void linkamStats_CallFunc(const iocshArgBuf *args)
+{
+	size_t i;
+	bool found = false;
+
+	// Every port unless one is named
+	for (i = 0; i < drivers.size(); i++) {
+		if (args[0].sval && args[0].sval[0] && strcmp(drivers[i]->portName, args[0].sval) != 0)
+			continue;
+		drivers[i]->reportStats(stdout);
+		found = true;
+	}
+	if (!found && args[0].sval && args[0].sval[0])
+		printf("linkamStats: no Linkam port named '%s'\n", args[0].sval);
 }
 
 /*
@@ -890,8 +2812,16 @@ static void linkamConnect_CallFunc(const iocshArgBuf *args)
 
 void linkamRegistrar(void)
 {
+	driversMutex = epicsMutexMustCreate();
 	iocshRegister(&linkamStatus_FuncDef, linkamStatus_CallFunc);
 	iocshRegister(&linkamConnect_FuncDef, linkamConnect_CallFunc);
+	iocshRegister(&linkamListDevices_FuncDef, linkamListDevices_CallFunc);
+	iocshRegister(&linkamPollGroup_FuncDef, linkamPollGroup_CallFunc);
+	iocshRegister(&linkamDeadband_FuncDef, linkamDeadband_CallFunc);
+	iocshRegister(&linkamHistory_FuncDef, linkamHistory_CallFunc);
+	iocshRegister(&linkamCapture_FuncDef, linkamCapture_CallFunc);
+	iocshRegister(&linkamRecorder_FuncDef, linkamRecorder_CallFunc);
+	iocshRegister(&linkamStats_FuncDef, linkamStats_CallFunc);
 }
 
 extern "C" {
@@ -1,5 +1,12 @@
 #include "asynPortDriver.h"
 #include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <map>
+#include <vector>
+#include "linkamRecorder.h"
+#include "linkamReplay.h"
+#include "linkamStats.h"
+#include "linkamVariant.h"
 
 #define P_TempString          "LINKAM_TEMP"
 #define P_RampRateSetString   "LINKAM_RAMPRATE_SET"
@@ -26,6 +33,35 @@
 #define P_VacuumData1String   "LINKAM_VAC_DATA1"
 #define P_NameString          "LINKAM_NAME"
 #define P_SerialString        "LINKAM_SERIAL"
+#define P_DataRateSetString   "LINKAM_DATA_RATE_SET"
+#define P_DataRateString      "LINKAM_DATA_RATE"
+#define P_RxTimeoutSetString  "LINKAM_RX_TIMEOUT_SET"
+#define P_UpdateRateString    "LINKAM_UPDATE_RATE"
+#define P_TimeStampOffsetString "LINKAM_TS_OFFSET"
+#define P_HistTimeString      "LINKAM_HIST_TIME"
+#define P_HistTempString      "LINKAM_HIST_TEMP"
+#define P_HistSetpointString  "LINKAM_HIST_SETPOINT"
+#define P_HistPowerString     "LINKAM_HIST_POWER"
+#define P_HistLNPSpeedString  "LINKAM_HIST_LNP_SPEED"
+#define P_HistCountString     "LINKAM_HIST_COUNT"
+#define P_HistDecimationString "LINKAM_HIST_DECIMATION"
+#define P_HistResetString     "LINKAM_HIST_RESET"
+#define P_RecFilenameString   "LINKAM_REC_FILENAME"
+#define P_RecStartString      "LINKAM_REC_START"
+#define P_RecStopString       "LINKAM_REC_STOP"
+#define P_RecRecordingString  "LINKAM_REC_RECORDING"
+#define P_RecCountString      "LINKAM_REC_COUNT"
+#define P_RecDroppedString    "LINKAM_REC_DROPPED"
+#define P_RecCurrentFileString "LINKAM_REC_CURRENT_FILE"
+#define P_StatsMsgString      "LINKAM_STATS_MSG"
+#define P_StatsValueTypeString "LINKAM_STATS_VALUE_TYPE"
+#define P_StatsCallsString    "LINKAM_STATS_CALLS"
+#define P_StatsFailuresString "LINKAM_STATS_FAILURES"
+#define P_StatsP50String      "LINKAM_STATS_P50"
+#define P_StatsP95String      "LINKAM_STATS_P95"
+#define P_StatsP99String      "LINKAM_STATS_P99"
+#define P_StatsMaxString      "LINKAM_STATS_MAX"
+#define P_StatsResetString    "LINKAM_STATS_RESET"
 
 // Tensile stage parameters
 #define P_TstMotorPosString     "LINKAM_TSTP_RBV"
@@ -47,7 +83,6 @@
 #define P_SampleThicknessSetString "LINKAM_SAMPLE_THICKNESS_SET"
 #define P_SampleThicknessString "LINKAM_SAMPLE_THICKNESS"
 #define P_SampleSizeSetString   "LINKAM_SAMPLE_SIZE_SET"
-#define P_SampleSizeString      "LINKAM_SAMPLE_SIZE"
 #define P_StrainEguSetString    "LINKAM_STRAIN_EGU_SET"
 #define P_StrainEguString       "LINKAM_STRAIN_EGU"
 #define P_StrainPercentageSetString "LINKAM_STRAIN_PERCENTAGE_SET"
@@ -56,6 +91,14 @@
 #define P_ShowForceAsDistString "LINKAM_SHOW_FORCE_AS_DIST"
 #define P_CalForceValSetString  "LINKAM_CAL_FORCE_VAL_SET"
 #define P_JawPositionString     "LINKAM_JAW_POSITION"
+#define P_TstSnapshotSeqString  "LINKAM_TST_SNAPSHOT_SEQ"
+#define P_TstCapTimeString      "LINKAM_TST_CAP_TIME"
+#define P_TstCapStrainString    "LINKAM_TST_CAP_STRAIN"
+#define P_TstCapStressString    "LINKAM_TST_CAP_STRESS"
+#define P_TstCapForceString     "LINKAM_TST_CAP_FORCE"
+#define P_TstCapPositionString  "LINKAM_TST_CAP_POSITION"
+#define P_TstCapCountString     "LINKAM_TST_CAP_COUNT"
+#define P_TstCapDoneString      "LINKAM_TST_CAP_DONE"
 #define P_StrainString          "LINKAM_STRAIN"
 #define P_StressString          "LINKAM_STRESS"
 #define P_TstTableModeSetString "LINKAM_TST_TABLE_MODE_SET"
@@ -105,16 +148,138 @@ struct ForceMotorParams
     float stepSize;
 };
 
+// Rate classes for readbacks. Fast values follow the SDK new-value events, medium
+// and slow are timed, once is only read at start-up and after a write.
+enum LinkamPollGroup
+{
+	LINKAM_POLL_FAST,
+	LINKAM_POLL_MEDIUM,
+	LINKAM_POLL_SLOW,
+	LINKAM_POLL_ONCE,
+	LINKAM_NUM_POLL_GROUPS
+};
+
+// Traces kept in the temperature history
+enum LinkamHistoryTrace
+{
+	LINKAM_HIST_TIME,
+	LINKAM_HIST_TEMP,
+	LINKAM_HIST_SETPOINT,
+	LINKAM_HIST_POWER,
+	LINKAM_HIST_LNP_SPEED,
+	LINKAM_NUM_HIST
+};
+
+// Traces recorded by the stress-strain capture
+enum LinkamCaptureTrace
+{
+	LINKAM_CAPTURE_TIME,
+	LINKAM_CAPTURE_STRAIN,
+	LINKAM_CAPTURE_STRESS,
+	LINKAM_CAPTURE_FORCE,
+	LINKAM_CAPTURE_POSITION,
+	LINKAM_NUM_CAPTURE
+};
+
+// Columns of the SDK call latency table, one element per message code called
+enum LinkamStatsColumn
+{
+	LINKAM_STATS_MSG,
+	LINKAM_STATS_VALUE_TYPE,
+	LINKAM_STATS_CALLS,
+	LINKAM_STATS_FAILURES,
+	LINKAM_STATS_P50,
+	LINKAM_STATS_P95,
+	LINKAM_STATS_P99,
+	LINKAM_STATS_MAX,
+	LINKAM_NUM_STATS
+};
+
+// Optional hardware a readback depends on, discovered at connect
+enum LinkamCapability
+{
+	LINKAM_CAP_ALWAYS  = 0,
+	LINKAM_CAP_LNP     = 1 << 0,
+	LINKAM_CAP_DSC     = 1 << 1,
+	LINKAM_CAP_VACUUM  = 1 << 2,
+	LINKAM_CAP_TENSILE = 1 << 3,
+	LINKAM_CAP_ALL     = (1 << 4) - 1
+};
+
+class linkamPortDriver;
+
+// How the driver uses a stage value parameter
+enum LinkamParamAccess
+{
+	LINKAM_ACCESS_READ  = 1 << 0, // Polled readback, refreshed by the acquisition thread
+	LINKAM_ACCESS_WRITE = 1 << 1  // Setting, written with SetValue
+};
+
+// A parameter that maps straight onto a stage value. One table of these creates the
+// parameters, builds the readbacks and dispatches writes.
+struct LinkamParamInfo
+{
+	const char *name;
+	asynParamType type;
+	int linkamPortDriver::*param;
+	LinkamSDK::StageValueType valueType;
+	LinkamValueKind valueKind; // Variant member the value travels in, filled in by LINKAM_VALUE
+	unsigned int access;    // LinkamParamAccess bits
+	unsigned int capability; // LinkamCapability needed for a readback to be polled
+	int group;              // Default LinkamPollGroup of a readback
+	uint64_t (*statusMask)(void); // Status flags whose change invalidates a readback, or NULL
+	double deadband;        // Default deadband of a float readback
+};
+
+// A stage value refreshed by the acquisition thread
+struct LinkamReadback
+{
+	int param;
+	asynParamType paramType;
+	LinkamSDK::StageValueType valueType;
+	LinkamValueKind valueKind;
+	int group;              // LinkamPollGroup the value is scheduled in
+	unsigned int capability; // LinkamCapability needed for the value to be polled
+	uint64_t statusMask;    // Controller status flags whose change invalidates a setting
+	LinkamSDK::Variant value;
+	bool valid;
+	bool refreshed;
+	bool writeRefresh;      // A setting behind it was written, re-read on the next pass whatever its group
+	double deadband;        // Smallest change of a float value that is published
+	double refreshPeriod;   // Publish at least this often (s) while changes are inside the deadband
+	double published;       // Last float value published
+	epicsTimeStamp publishedTime;
+	bool publishValid;      // published holds a value from the controller
+	bool snapshot;          // Part of the tensile snapshot, read and published as one sample
+};
+
 class linkamPortDriver : public asynPortDriver {
 public:
-	linkamPortDriver(const char *);
+	linkamPortDriver(const char *, int pollPeriodMs, int dataRateMs, const LinkamSDK::CommsInfo *commsInfo,
+	                 const char *replayFile = NULL, double replaySpeed = 1.0);
+    bool replaying(void) const { return replay != NULL; }
+    const char *usbSerial(void) const;
+    bool openComms(void);
+    bool controllerConnected(CommsHandle hDevice);
+    bool controllerDisconnected(CommsHandle hDevice);
+    void acquisitionTask(void);
+    void newValue(LinkamSDK::ControllerStatus status);
+    bool newValue(CommsHandle hDevice, LinkamSDK::ControllerStatus status);
+    asynStatus setPollGroup(const char *groupName, int periodMs, int nParams, char **paramNames);
+    asynStatus setDeadband(double deadband, int refreshMs, int nParams, char **paramNames);
+    asynStatus setHistory(int depth, int decimation);
+    asynStatus setCaptureDepth(int depth);
+    asynStatus setRecorderFileSize(int fileSizeMB);
+    void reportStats(FILE *fp);
+    void printLinkam3Status();
+	virtual void report(FILE *fp, int details);
     asynStatus SetTstGotoMode(float position, float vel);
     asynStatus SetTstForceMode(float force);
 	virtual asynStatus readFloat64(asynUser *, epicsFloat64 *);
-	virtual asynStatus readOctet(asynUser *, char *, size_t, size_t *, int *);
+	virtual asynStatus readFloat64Array(asynUser *, epicsFloat64 *, size_t, size_t *);
 	virtual asynStatus writeFloat64(asynUser *, epicsFloat64);
 	virtual asynStatus writeInt32(asynUser *, epicsInt32);
-	virtual asynStatus readInt32(asynUser *, epicsInt32 *);
+	virtual asynStatus connect(asynUser *);
 protected:
 	//epicsEventId eventId_;
 	int P_Temp;
@@ -143,6 +308,35 @@ protected:
 	int P_VacuumData1;
 	int P_Name;
 	int P_Serial;
+	int P_DataRateSet;
+	int P_DataRate;
+	int P_RxTimeoutSet;
+	int P_UpdateRate;
+	int P_TimeStampOffset;
+	int P_HistTime;
+	int P_HistTemp;
+	int P_HistSetpoint;
+	int P_HistPower;
+	int P_HistLNPSpeed;
+	int P_HistCount;
+	int P_HistDecimation;
+	int P_HistReset;
+	int P_RecFilename;
+	int P_RecStart;
+	int P_RecStop;
+	int P_RecRecording;
+	int P_RecCount;
+	int P_RecDropped;
+	int P_RecCurrentFile;
+	int P_StatsMsg;
+	int P_StatsValueType;
+	int P_StatsCalls;
+	int P_StatsFailures;
+	int P_StatsP50;
+	int P_StatsP95;
+	int P_StatsP99;
+	int P_StatsMax;
+	int P_StatsReset;
     // Tensile stage parameters
     int P_TstMotorPos;
     int P_Force;
@@ -163,7 +357,6 @@ protected:
     int P_SampleThicknessSet;
     int P_SampleThickness;
     int P_SampleSizeSet;
-    int P_SampleSize;
     int P_StrainEguSet;
     int P_StrainEgu;
     int P_StrainPercentageSet;
@@ -172,6 +365,14 @@ protected:
     int P_ShowForceAsDist;
     int P_CalForceValSet;
     int P_JawPosition;
+    int P_TstSnapshotSeq;
+    int P_TstCapTime;
+    int P_TstCapStrain;
+    int P_TstCapStress;
+    int P_TstCapForce;
+    int P_TstCapPosition;
+    int P_TstCapCount;
+    int P_TstCapDone;
     int P_Strain;
     int P_Stress;
     int P_TstTableModeSet;
@@ -217,16 +418,147 @@ protected:
 
     // Status printing functions
     void printErrorConnectionStatus(LinkamSDK::Variant connectionResult);
-    void printLinkam3Status();
 
 
 private:
+	static const LinkamParamInfo paramTable[];
+	const LinkamParamInfo *findParamInfo(int param) const
+	{
+		return param >= 0 && (size_t)param < paramInfo.size() ? paramInfo[param] : NULL;
+	}
 	void rtrim(char *);
+	int findReadback(const char *paramName);
+	bool processMessage(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant *result,
+	                    LinkamSDK::Variant param1 = LinkamSDK::Variant(), LinkamSDK::Variant param2 = LinkamSDK::Variant(),
+	                    LinkamSDK::Variant param3 = LinkamSDK::Variant());
+	bool replayMessage(LinkamSDK::LinkamFunctionMsgCode msg, LinkamSDK::Variant *result,
+	                   LinkamSDK::Variant param1, LinkamSDK::Variant param2);
+	template <LinkamSDK::StageValueType VT> bool getValue(typename LinkamValueTraits<VT>::type *value);
+	template <LinkamSDK::StageValueType VT> bool setValue(typename LinkamValueTraits<VT>::type value);
+	void refreshIdentity(void);
+	void discoverCapabilities(void);
+	void restoreSettings(void);
+	asynStatus setDataRate(int dataRateMs);
+	asynStatus setRxTimeout(int timeoutMs);
+	bool addHistorySample(const epicsTimeStamp *time);
+	size_t copyHistory(int trace, epicsFloat64 *value, size_t maxPoints);
+	void publishHistory(void);
+	void resetHistory(void);
+	bool runMotor(bool run);
+	void refreshWritten(LinkamSDK::StageValueType valueType);
+	void startCapture(void);
+	void stopCapture(void);
+	bool addCaptureSample(const epicsTimeStamp *time);
+	void publishCapture(void);
+	void recordSample(const epicsTimeStamp *time);
+	void publishRecorder(void);
+	void publishStats(void);
+	void noteStatus(LinkamSDK::ControllerStatus status);
+	void addReadback(const LinkamParamInfo &info);
+	void pollReadbacks(unsigned int groupsDue, uint64_t statusChanged, LinkamSDK::ControllerStatus *status,
+	                   const epicsTimeStamp *statusTime, bool captureDue);
+	std::vector<const LinkamParamInfo *> paramInfo; // paramTable entry of each parameter, by index
+	// The controller this port talks to
+	LinkamSDK::CommsInfo commsInfo;
+	CommsHandle handle;     // Connection calls are made on, written by the acquisition thread under the port lock
+	bool commsOpen;         // handle is a live connection, calls fail without reaching the SDK otherwise
+	// Non-blocking open, guarded by statusMutex: the SDK's connected event hands the handle to
+	// the acquisition thread, which brings the port up
+	CommsHandle sdkHandle;  // Given to the open request, the SDK callbacks are matched against it
+	bool openPending;       // Waiting for the connected event
+	bool connectPending;    // Connected, connectedHandle not yet taken up
+	CommsHandle connectedHandle;
+	bool disconnectPending; // Controller gone, the port not yet taken down
+	// Reconnection, acquisition thread only
+	double reconnectDelay;  // Before the next attempt once one is refused (s), doubles up to LINKAM_RECONNECT_MAX
+	epicsTimeStamp reconnectTime; // Earliest time for the next attempt
+	bool restorePending;    // Settings to be written back once the identity has been read
+	std::map<int, double> settings; // Last value written to each stage setting, by parameter, under the port lock
+	std::vector<LinkamReadback> readbacks;
+	double groupPeriod[LINKAM_NUM_POLL_GROUPS];
+	epicsTimeStamp groupLastPoll[LINKAM_NUM_POLL_GROUPS];
+	epicsEventId newValueEvent;
+	epicsMutexId statusMutex;
+	LinkamSDK::ControllerStatus lastStatus;
+	epicsTimeStamp lastStatusTime; // When the SDK reported lastStatus
+	uint64_t statusChanged;
+	bool statusPending;
+	unsigned int newValueCount; // SDK new-value callbacks since the update rate was last measured
+	epicsTimeStamp rateStart;
+	bool refreshPending;
+	bool identityPending;   // Controller/stage identity strings and capabilities need re-reading
+	unsigned int capabilities; // LinkamCapability bits of the connected hardware
+	int snapshotSeq;        // Tensile snapshots published
+	// Temperature history, one preallocated ring per LinkamHistoryTrace
+	int historyParams[LINKAM_NUM_HIST];
+	std::vector<epicsFloat64> history[LINKAM_NUM_HIST];
+	std::vector<epicsFloat64> historyOut; // Scratch for publishing a trace oldest first
+	size_t historyDepth;
+	size_t historyHead;     // Next slot to write
+	size_t historyCount;
+	int historyTick;        // Fast samples since the last one kept
+	bool historyUnpublished; // Samples kept since the waveforms were last published
+	// Stress-strain capture while the TST motor runs, preallocated per LinkamCaptureTrace
+	int captureParams[LINKAM_NUM_CAPTURE];
+	int captureReadbacks[LINKAM_NUM_CAPTURE]; // Index into readbacks for each trace but time
+	std::vector<epicsFloat64> capture[LINKAM_NUM_CAPTURE];
+	size_t captureDepth;
+	size_t captureCount;
+	bool capturing;
+	bool captureMotorMoved; // Motor seen running since the capture started
+	epicsTimeStamp captureStart;
+	// Binary recording of every sample, one channel per readback
+	linkamRecorder *recorder;
+	std::vector<double> recordValues; // Latest value of each channel
+	uint64_t recordStatus;  // Latest controller status flags
+	linkamReplay *replay;   // Stands in for the controller when replaying a recorded run
+	// Latency of every SDK call, published as one column per LinkamStatsColumn
+	linkamStats stats;
+	int statsParams[LINKAM_NUM_STATS];
+	std::vector<epicsFloat64> statsOut[LINKAM_NUM_STATS];
+	int errorState;         // Last controller error flag seen, -1 before the first status
 	bool LNP_AutoMode;
 	int LNP_ManualSpeed;
     PositionMotorParams pMotorParams;
     ForceMotorParams fMotorParams;
 };
 
+//
+// \brief     Read one stage value as its own C++ type.
+// \return    false if the SDK call failed, value is then left alone.
+//
+template <LinkamSDK::StageValueType VT>
+inline bool linkamPortDriver::getValue(typename LinkamValueTraits<VT>::type *value)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant result;
+
+	param1.vStageValueType = VT;
+	if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_GetValue, &result, param1))
+		return false;
+	*value = LinkamValueTraits<VT>::get(result);
+	return true;
+}
+
+//
+// \brief     Write one stage value, passed as its own C++ type, and have its readback re-read.
+//            Called with the port locked.
+// \return    false if the SDK call failed.
+//
+template <LinkamSDK::StageValueType VT>
+inline bool linkamPortDriver::setValue(typename LinkamValueTraits<VT>::type value)
+{
+	LinkamSDK::Variant param1;
+	LinkamSDK::Variant param2;
+	LinkamSDK::Variant result;
+
+	param1.vStageValueType = VT;
+	LinkamValueTraits<VT>::set(param2, value);
+	if (!processMessage(LinkamSDK::eLinkamFunctionMsgCode_SetValue, &result, param1, param2))
+		return false;
+	refreshWritten(VT);
+	return true;
+}
+
 #define NUM_LINKAM_PARAMS (&LAST_LINKAM_COMMAND - &FIRST_LINKAM_COMMAND + 1)
 
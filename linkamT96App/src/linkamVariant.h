@@ -0,0 +1,110 @@
+#ifndef LINKAM_VARIANT_H
+#define LINKAM_VARIANT_H
+
+#include "include/LinkamSDK.h"
+
+// The Variant member a stage value travels in
+enum LinkamValueKind
+{
+	LINKAM_VALUE_FLOAT32,
+	LINKAM_VALUE_INT32,
+	LINKAM_VALUE_UINT32,
+	LINKAM_VALUE_BOOLEAN,
+	LINKAM_VALUE_TST_MODE,
+	LINKAM_VALUE_TST_STATUS
+};
+
+//
+// \brief     C++ type of a stage value and the Variant member carrying it, as documented in
+//            CommonStageAPI.h. Only the value types the driver uses have traits, so reading or
+//            writing any other one, or naming it in the parameter table, fails to compile.
+//
+template <LinkamSDK::StageValueType VT> struct LinkamValueTraits;
+
+#define LINKAM_VALUE_TRAITS(valueType, cType, member, valueKind) \
+	template <> struct LinkamValueTraits<LinkamSDK::valueType> \
+	{ \
+		typedef cType type; \
+		static const LinkamValueKind kind = valueKind; \
+		static type get(const LinkamSDK::Variant &variant) { return variant.member; } \
+		static void set(LinkamSDK::Variant &variant, type value) { variant.member = value; } \
+	};
+
+// Heater, LNP, DSC and vacuum
+LINKAM_VALUE_TRAITS(eStageValueTypeHeater1Temp,          float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeHeaterRate,           float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeHeaterSetpoint,       float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeHeater1Power,         float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeHeater1LNPSpeed,      float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeRampHoldTime,         float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeRampHoldRemaining,    float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeDsc,                  uint32_t, vUint32,  LINKAM_VALUE_UINT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeVacuum,               float,    vFloat32, LINKAM_VALUE_FLOAT32)
+// The SDK fills a VacuumSensorData buffer for this one; the driver has only ever polled it as a float
+LINKAM_VALUE_TRAITS(eStageValueTypeVacuumOptionBoardSensor1Data, float, vFloat32, LINKAM_VALUE_FLOAT32)
+
+// Tensile stage
+LINKAM_VALUE_TRAITS(eStageValueTypeTstMotorPos,          float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstRawMotorPos,       float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstMotorVel,          float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstMotorDistanceSetpoint, float, vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeMotorTstDefaultSpeed, float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstForce,             float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstForceGauge,        float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstForceSetpoint,     float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstJawToJawSize,      float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstJawPosition,       float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstMaxExtentPosition, float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstMinExtentPosition, float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstStrain,            float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstStress,            float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstPidKp,             float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstPidKi,             float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstPidKd,             float,    vFloat32, LINKAM_VALUE_FLOAT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstTableDirection,    bool,     vBoolean, LINKAM_VALUE_BOOLEAN)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstTableMode,         LinkamSDK::TSTMode, vTSTMode, LINKAM_VALUE_TST_MODE)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstStatus,            LinkamSDK::TSTStatus, vTSTStatus, LINKAM_VALUE_TST_STATUS)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstStrainEngineeringUnits, bool, vBoolean, LINKAM_VALUE_BOOLEAN)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstStrainPercentage,  bool,     vBoolean, LINKAM_VALUE_BOOLEAN)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstShowAsForceDistance, bool,   vBoolean, LINKAM_VALUE_BOOLEAN)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstIsJawMonitorEnabled, bool,   vBoolean, LINKAM_VALUE_BOOLEAN)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstCycleCountLimit,   int32_t,  vInt32,   LINKAM_VALUE_INT32)
+LINKAM_VALUE_TRAITS(eStageValueTypeTstCyclesRemaining,   int32_t,  vInt32,   LINKAM_VALUE_INT32)
+
+#undef LINKAM_VALUE_TRAITS
+
+// A stage value type and its LinkamValueKind, for tables that dispatch on the kind at run time
+#define LINKAM_VALUE(valueType) LinkamSDK::valueType, LinkamValueTraits<LinkamSDK::valueType>::kind
+
+//
+// \brief     A stage value of the given kind as a double, for the parameter library.
+//
+inline double linkamVariantValue(const LinkamSDK::Variant &variant, LinkamValueKind kind)
+{
+	switch (kind) {
+	case LINKAM_VALUE_INT32:      return variant.vInt32;
+	case LINKAM_VALUE_UINT32:     return variant.vUint32;
+	case LINKAM_VALUE_BOOLEAN:    return variant.vBoolean;
+	case LINKAM_VALUE_TST_MODE:   return variant.vTSTMode;
+	case LINKAM_VALUE_TST_STATUS: return variant.vTSTStatus.value;
+	default:                      return variant.vFloat32;
+	}
+}
+
+//
+// \brief     Store a parameter value in the Variant member of the given kind.
+//
+inline void linkamSetVariantValue(LinkamSDK::Variant &variant, LinkamValueKind kind, double value)
+{
+	variant.vUint64 = 0;
+	switch (kind) {
+	case LINKAM_VALUE_INT32:      variant.vInt32 = (int32_t)value; break;
+	case LINKAM_VALUE_UINT32:     variant.vUint32 = (uint32_t)value; break;
+	case LINKAM_VALUE_BOOLEAN:    variant.vBoolean = value != 0; break;
+	case LINKAM_VALUE_TST_MODE:   variant.vTSTMode = (LinkamSDK::TSTMode)(int)value; break;
+	case LINKAM_VALUE_TST_STATUS: variant.vTSTStatus.value = (uint32_t)value; break;
+	default:                      variant.vFloat32 = (float)value; break;
+	}
+}
+
+#endif